@@ -20,7 +20,7 @@ const DELTA: c_double = 0.0111;
 
 macro_rules! bench {
     ($name:ident, $name_id:ident, $name_noset:ident, $name_set_unsafe:ident,
-        $formula:expr, $name_native:ident,
+        $formula:expr, $name_native:ident, $name_jit:ident,
         $x:ident, $y:ident, $expr:expr) => {
         // "Normal" usage of API
         #[bench]
@@ -49,9 +49,9 @@ macro_rules! bench {
         // The pointers are directly incremented
         #[bench]
         fn $name_set_unsafe(b: &mut Bencher) {
-            macro_rules! c_string {
+            macro_rules! c_str {
                 ($s:expr) => {
-                    ::std::ffi::CString::new($s).unwrap().as_ptr()
+                    ($s.as_ptr() as *const _, $s.len())
                 };
             }
 
@@ -61,14 +61,17 @@ macro_rules! bench {
             unsafe {
                 let s = symbol_table_new();
                 symbol_table_add_pi(s);
-                symbol_table_add_variable(s, c_string!("x"), &x as *const _, false);
-                symbol_table_add_variable(s, c_string!("y"), &y as *const _, false);
+                let (x_name, x_len) = c_str!("x");
+                let (y_name, y_len) = c_str!("y");
+                symbol_table_add_variable(s, x_name, x_len, &x as *const _, false);
+                symbol_table_add_variable(s, y_name, y_len, &y as *const _, false);
 
                 let e = expression_new();
                 expression_register_symbol_table(e, s);
 
                 let p = parser_new();
-                parser_compile(p, c_string!($formula), e);
+                let (formula, formula_len) = c_str!($formula);
+                parser_compile(p, formula, formula_len, e);
 
                 b.iter(|| {
                     let mut total = 0.;
@@ -88,6 +91,30 @@ macro_rules! bench {
             }
         }
 
+        // Compiled to native code (falls back to ExprTk if not supported)
+        #[cfg(feature = "jit")]
+        #[bench]
+        fn $name_jit(b: &mut Bencher) {
+            let mut s = SymbolTable::new();
+            s.add_pi();
+            let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+            let y_id = s.add_variable("y", 0.).unwrap().unwrap();
+            let mut e = JitExpression::new(Expression::new($formula, s).unwrap());
+
+            b.iter(|| {
+                let mut total = 0.;
+                *e.expression_mut().symbols_mut().value_mut(x_id) = XMIN;
+                *e.expression_mut().symbols_mut().value_mut(y_id) = YMIN;
+                while e.expression().symbols().value(x_id) < XMAX {
+                    *e.expression_mut().symbols_mut().value_mut(x_id) += DELTA;
+                    while e.expression().symbols().value(y_id) < YMAX {
+                        *e.expression_mut().symbols_mut().value_mut(y_id) += DELTA;
+                        total += e.value();
+                    }
+                }
+            });
+        }
+
         // Native representation of the same formula
         #[bench]
         fn $name_native(b: &mut Bencher) {
@@ -114,6 +141,7 @@ bench!(
     bench1_unsafe,
     "(y + x)",
     bench1_native,
+    bench1_jit,
     x,
     y,
     x + y
@@ -126,6 +154,7 @@ bench!(
     bench2_unsafe,
     "2 * (y + x)",
     bench2_native,
+    bench2_jit,
     x,
     y,
     2. * (y + x)
@@ -138,6 +167,7 @@ bench!(
     bench3_unsafe,
     "(2 * y + 2 * x)",
     bench3_native,
+    bench3_jit,
     x,
     y,
     2. * y + 2. * x
@@ -150,6 +180,7 @@ bench!(
     bench4_unsafe,
     "((1.23 * x^2) / y) - 123.123",
     bench4_native,
+    bench4_jit,
     x,
     y,
     ((1.23 * x.powf(2.)) / y) - 123.123
@@ -162,6 +193,7 @@ bench!(
     bench5_unsafe,
     "(y + x / y) * (x - y / x)",
     bench5_native,
+    bench5_jit,
     x,
     y,
     (y + x / y) * (x - y / x)
@@ -174,6 +206,7 @@ bench!(
     bench6_unsafe,
     "x / ((x + y) + (x - y)) / y",
     bench6_native,
+    bench6_jit,
     x,
     y,
     x / ((x + y) + (x - y)) / y
@@ -186,6 +219,7 @@ bench!(
     bench7_unsafe,
     "1 - ((x * y) + (y / x)) - 3",
     bench7_native,
+    bench7_jit,
     x,
     y,
     1. - ((x * y) + (y / x)) - 3.
@@ -198,6 +232,7 @@ bench!(
     bench8_unsafe,
     "(5.5 + x) + (2 * x - 2 / 3 * y) * (x / 3 + y / 4) + (y + 7.7)",
     bench8_native,
+    bench8_jit,
     x,
     y,
     (5.5 + x) + (2. * x - 2. / 3. * y) * (x / 3. + y / 4.) + (y + 7.7)
@@ -210,6 +245,7 @@ bench!(
     bench9_unsafe,
     "1.1x^1 + 2.2y^2 - 3.3x^3 + 4.4y^15 - 5.5x^23 + 6.6y^55",
     bench9_native,
+    bench9_jit,
     x,
     y,
     1.1 * x.powf(1.) + 2.2 * y.powf(2.) - 3.3 * x.powf(3.) + 4.4 * y.powf(15.) - 5.5 * x.powf(23.)
@@ -223,6 +259,7 @@ bench!(
     bench10_unsafe,
     "sin(2 * x) + cos(pi / y)",
     bench10_native,
+    bench10_jit,
     x,
     y,
     (2. * x).sin() + (PI / y).cos()
@@ -235,6 +272,7 @@ bench!(
     bench11_unsafe,
     "1 - sin(2 * x) + cos(pi / y)",
     bench11_native,
+    bench11_jit,
     x,
     y,
     1. - (2. * x).sin() + (PI / y).cos()
@@ -247,6 +285,7 @@ bench!(
     bench12_unsafe,
     "sqrt(111.111 - sin(2 * x) + cos(pi / y) / 333.333)",
     bench12_native,
+    bench12_jit,
     x,
     y,
     (111.111 - (2. * x).sin() + (PI / y).sin() / 333.333).sqrt()
@@ -259,6 +298,7 @@ bench!(
     bench13_unsafe,
     "(x^2 / sin(2 * pi / y)) - x / 2",
     bench13_native,
+    bench13_jit,
     x,
     y,
     (x.powf(2.) / (2. * PI / y).sin()) - x / 2.
@@ -271,6 +311,7 @@ bench!(
     bench14_unsafe,
     "x + (cos(y - sin(2 / x * pi)) - sin(x - cos(2 * y / pi))) - y",
     bench14_native,
+    bench14_jit,
     x,
     y,
     x + ((y - (2. / x * PI).sin()).cos() - (x - (2. * y / PI).cos()).sin()) - y
@@ -283,6 +324,7 @@ bench!(
     bench16_unsafe,
     "max(3.33, min(sqrt(1 - sin(2 * x) + cos(pi / y) / 3), 1.11))",
     bench16_native,
+    bench16_jit,
     x,
     y,
     (3.33 as c_double).max(
@@ -299,6 +341,7 @@ bench!(
     bench17_unsafe,
     "if((y + (x * 2.2)) <= (x + y + 1.1), x - y, x * y) + 2 * pi / x",
     bench17_native,
+    bench17_jit,
     x,
     y,
     (if (y + (x * 2.2)) <= (x + y + 1.1) {
@@ -307,3 +350,135 @@ bench!(
         x * y
     }) + 2. * PI / x
 );
+
+// Compile throughput
+
+const COMPILE_FORMULAS: &[&str] = &[
+    "(y + x)",
+    "((1.23 * x^2) / y) - 123.123",
+    "(5.5 + x) + (2 * x - 2 / 3 * y) * (x / 3 + y / 4) + (y + 7.7)",
+    "1.1x^1 + 2.2y^2 - 3.3x^3 + 4.4y^15 - 5.5x^23 + 6.6y^55",
+    "sqrt(111.111 - sin(2 * x) + cos(pi / y) / 333.333)",
+    "x + (cos(y - sin(2 / x * pi)) - sin(x - cos(2 * y / pi))) - y",
+    "if((y + (x * 2.2)) <= (x + y + 1.1), x - y, x * y) + 2 * pi / x",
+];
+
+fn compile_symbols() -> SymbolTable {
+    let mut s = SymbolTable::new();
+    s.add_pi();
+    s.add_variable("x", 0.).unwrap().unwrap();
+    s.add_variable("y", 0.).unwrap().unwrap();
+    s
+}
+
+// A new parser for every expression (the behaviour before parsers were pooled)
+#[bench]
+fn compile_fresh_parser(b: &mut Bencher) {
+    let s = compile_symbols();
+    b.iter(|| {
+        for f in COMPILE_FORMULAS {
+            let parser = Parser::new();
+            test::black_box(Expression::with_parser(f, s.clone(), &parser).unwrap());
+        }
+    });
+}
+
+#[bench]
+fn compile_shared_parser(b: &mut Bencher) {
+    let s = compile_symbols();
+    let parser = Parser::new();
+    b.iter(|| {
+        for f in COMPILE_FORMULAS {
+            test::black_box(Expression::with_parser(f, s.clone(), &parser).unwrap());
+        }
+    });
+}
+
+// Expression::new, which uses the thread-local parser pool
+#[bench]
+fn compile_pooled_parser(b: &mut Bencher) {
+    let s = compile_symbols();
+    b.iter(|| {
+        for f in COMPILE_FORMULAS {
+            test::black_box(Expression::new(f, s.clone()).unwrap());
+        }
+    });
+}
+
+// Evaluation of columnar input: row by row vs. eval_batch
+
+const BATCH_FORMULA: &str = "(5.5 + x) + (2 * x - 2 / 3 * y) * (x / 3 + y / 4) + (y + 7.7)";
+const BATCH_ROWS: usize = 100_000;
+
+fn batch_input() -> (Vec<c_double>, Vec<c_double>) {
+    let x = (0..BATCH_ROWS)
+        .map(|i| XMIN + i as c_double * DELTA)
+        .collect();
+    let y = (0..BATCH_ROWS)
+        .map(|i| YMAX - i as c_double * DELTA)
+        .collect();
+    (x, y)
+}
+
+#[bench]
+fn batch_rows(b: &mut Bencher) {
+    let (x, y) = batch_input();
+    let mut e = Expression::new(BATCH_FORMULA, compile_symbols()).unwrap();
+    let x_id = e.symbols().get_var_id("x").unwrap().unwrap();
+    let y_id = e.symbols().get_var_id("y").unwrap().unwrap();
+    let mut out = vec![0.; BATCH_ROWS];
+    b.iter(|| {
+        for ((o, &x), &y) in out.iter_mut().zip(&x).zip(&y) {
+            *e.symbols_mut().value_mut(x_id) = x;
+            *e.symbols_mut().value_mut(y_id) = y;
+            *o = e.value();
+        }
+    });
+}
+
+#[bench]
+fn batch_eval(b: &mut Bencher) {
+    let (x, y) = batch_input();
+    let mut e = Expression::new(BATCH_FORMULA, compile_symbols()).unwrap();
+    let x_id = e.symbols().get_var_id("x").unwrap().unwrap();
+    let y_id = e.symbols().get_var_id("y").unwrap().unwrap();
+    let mut out = vec![0.; BATCH_ROWS];
+    b.iter(|| {
+        e.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+    });
+}
+
+#[bench]
+fn batch_block(b: &mut Bencher) {
+    let (x, y) = batch_input();
+    let e = Expression::new(BATCH_FORMULA, compile_symbols()).unwrap();
+    let x_id = e.symbols().get_var_id("x").unwrap().unwrap();
+    let y_id = e.symbols().get_var_id("y").unwrap().unwrap();
+    let mut evaluator = BlockEvaluator::new(e);
+    assert!(evaluator.is_vectorized());
+    let mut out = vec![0.; BATCH_ROWS];
+    b.iter(|| {
+        evaluator.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+    });
+}
+
+// Cloning compiled expressions vs. compiling them
+
+#[bench]
+fn clone_symbols(b: &mut Bencher) {
+    let s = compile_symbols();
+    b.iter(|| test::black_box(s.clone()));
+}
+
+#[bench]
+fn clone_expressions(b: &mut Bencher) {
+    let exprs: Vec<_> = COMPILE_FORMULAS
+        .iter()
+        .map(|f| Expression::new(f, compile_symbols()).unwrap())
+        .collect();
+    b.iter(|| {
+        for e in &exprs {
+            test::black_box(e.clone());
+        }
+    });
+}
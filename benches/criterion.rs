@@ -0,0 +1,368 @@
+//! Benchmark suite running on stable Rust, based on
+//! [Criterion](https://docs.rs/criterion):
+//!
+//! ```sh
+//! cargo bench --bench criterion --features parallel
+//! cargo bench --bench criterion --features parallel,arrow
+//! ```
+//!
+//! The results are written to `target/criterion/<group>/<benchmark>/new/estimates.json`.
+//! Regressions can be detected by saving a baseline (`-- --save-baseline main`)
+//! and comparing against it later (`-- --baseline main`).
+
+use std::f64::consts::PI;
+
+use criterion::{
+    black_box, criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion, Throughput,
+};
+use exprtk_rs::*;
+
+const SHORT_FORMULA: &str = "x + 1";
+const MEDIUM_FORMULA: &str = "(y + x / y) * (x - y / x) + sqrt(1.1 - sin(2 * x) + cos(pi / y))";
+
+/// Formula with `n_terms` terms and two variables
+fn large_formula(n_terms: usize) -> String {
+    (0..n_terms)
+        .map(|i| format!("(x + {}) * (y - {}.5)", i, i))
+        .collect::<Vec<_>>()
+        .join(" + ")
+}
+
+fn symbols() -> (SymbolTable, usize, usize) {
+    let mut s = SymbolTable::new();
+    s.add_pi();
+    let x_id = s.add_variable("x", 1.).unwrap().unwrap();
+    let y_id = s.add_variable("y", 2.).unwrap().unwrap();
+    (s, x_id, y_id)
+}
+
+fn column(n: usize, offset: f64) -> Vec<f64> {
+    (0..n).map(|i| i as f64 * 0.01 + offset).collect()
+}
+
+fn compile(c: &mut Criterion) {
+    let mut group = c.benchmark_group("compile");
+    let large = large_formula(200);
+    for &(name, formula) in &[
+        ("short", SHORT_FORMULA),
+        ("medium", MEDIUM_FORMULA),
+        ("large", &large),
+    ] {
+        let (s, _, _) = symbols();
+        group.throughput(Throughput::Bytes(formula.len() as u64));
+        group.bench_with_input(BenchmarkId::new("pooled", name), formula, |b, f| {
+            b.iter(|| Expression::new(f, s.clone()).unwrap())
+        });
+        let parser = Parser::new();
+        group.bench_with_input(BenchmarkId::new("parser", name), formula, |b, f| {
+            b.iter(|| Expression::with_parser(f, s.clone(), &parser).unwrap())
+        });
+    }
+    // Fixed cost added to every compilation by releasing the symbol tables
+    // (see `Parser`): it compiles a constant without symbols, so this is about
+    // twice the overhead.
+    group.throughput(Throughput::Elements(1));
+    let parser = Parser::new();
+    let empty = SymbolTable::new();
+    group.bench_function("release", |b| {
+        b.iter_batched(
+            || empty.clone(),
+            |s| Expression::with_parser("0", s, &parser).unwrap(),
+            BatchSize::SmallInput,
+        )
+    });
+    group.finish();
+}
+
+fn clone(c: &mut Criterion) {
+    let mut group = c.benchmark_group("clone");
+    for &n_vars in &[10, 100] {
+        let mut s = SymbolTable::new();
+        for i in 0..n_vars {
+            s.add_variable(&format!("x{}", i), i as f64).unwrap();
+        }
+        group.bench_with_input(BenchmarkId::new("symbol_table", n_vars), &s, |b, s| {
+            b.iter(|| s.clone())
+        });
+    }
+    let large = large_formula(200);
+    for &(name, formula) in &[("short", SHORT_FORMULA), ("large", &large)] {
+        let (s, _, _) = symbols();
+        let expr = Expression::new(formula, s).unwrap();
+        group.bench_with_input(BenchmarkId::new("expression", name), &expr, |b, e| {
+            b.iter(|| e.clone())
+        });
+    }
+    group.finish();
+}
+
+fn resolver(c: &mut Criterion) {
+    let mut group = c.benchmark_group("resolver");
+    let names: Vec<_> = (0..10).map(|i| format!("v{}", i)).collect();
+    let formula = names.join(" + ");
+    let mut s = SymbolTable::new();
+    for n in &names {
+        s.add_variable(n, 1.).unwrap();
+    }
+    group.bench_function("predefined", |b| {
+        b.iter(|| Expression::new(&formula, s.clone()).unwrap())
+    });
+    group.bench_function("handle_unknown", |b| {
+        b.iter(|| {
+            Expression::handle_unknown(&formula, SymbolTable::new(), |name, s| {
+                s.add_variable(name, 1.).unwrap();
+                Ok(())
+            })
+            .unwrap()
+        })
+    });
+    group.bench_function("parse_vars", |b| {
+        b.iter(|| Expression::parse_vars(&formula, SymbolTable::new()).unwrap())
+    });
+    group.finish();
+}
+
+fn strings_vectors(c: &mut Criterion) {
+    let mut group = c.benchmark_group("strings_vectors");
+
+    let mut s = SymbolTable::new();
+    let s1 = s
+        .add_stringvar("s1", "some longer string")
+        .unwrap()
+        .unwrap();
+    s.add_stringvar("s2", "string").unwrap();
+    let mut expr = Expression::new("(s1 like '*string') + (s2 in s1) + s1[]", s).unwrap();
+    group.bench_function("string_ops", |b| b.iter(|| expr.value()));
+    group.bench_function("set_string", |b| {
+        b.iter(|| {
+            expr.symbols_mut()
+                .set_string(s1, black_box("another string"));
+            expr.value()
+        })
+    });
+
+    for &len in &[16, 1024] {
+        let mut s = SymbolTable::new();
+        let v_id = s.add_vector("v", &column(len, 0.)).unwrap().unwrap();
+        s.add_vector("w", &column(len, 1.)).unwrap();
+        let mut expr = Expression::new("sum(v * w) + avg(v) - max(w)", s).unwrap();
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_function(BenchmarkId::new("vector_ops", len), |b| {
+            b.iter(|| expr.value())
+        });
+        group.bench_function(BenchmarkId::new("vector_update", len), |b| {
+            b.iter(|| {
+                for x in expr.symbols_mut().vector_mut(v_id) {
+                    *x += 1.;
+                }
+                expr.value()
+            })
+        });
+    }
+    group.finish();
+}
+
+fn functions(c: &mut Criterion) {
+    let mut group = c.benchmark_group("functions");
+    let (mut s, x_id, _) = symbols();
+    s.add_func1("f1", |x| x + 1.).unwrap();
+    s.add_func3("f3", |x, y, z| x + y + z).unwrap();
+    s.add_vararg_func("fv", |args| args.iter().sum()).unwrap();
+    s.add_generic_func("fg", "TTT", |args| {
+        args.iter().map(|a| a.scalar().unwrap()).sum()
+    })
+    .unwrap();
+    s.add_vec_func("fb", 1, |args, out| {
+        for (o, &x) in out.iter_mut().zip(args[0]) {
+            *o = x + 1.;
+        }
+    })
+    .unwrap();
+
+    for &(name, formula) in &[
+        ("builtin", "x + 1"),
+        ("func1", "f1(x)"),
+        ("func3", "f3(x, x, x)"),
+        ("vararg", "fv(x, x, x)"),
+        ("generic", "fg(x, x, x)"),
+        ("vec_func", "fb(x)"),
+    ] {
+        let mut expr = Expression::new(formula, s.clone()).unwrap();
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                *expr.symbols_mut().value_mut(x_id) += 1.;
+                expr.value()
+            })
+        });
+    }
+
+    // one call per block of rows instead of one per row
+    let n = 10_000;
+    let x = column(n, 0.);
+    let mut out = vec![0.; n];
+    group.throughput(Throughput::Elements(n as u64));
+    for &(name, formula) in &[("batch_func1", "f1(x)"), ("batch_vec_func", "fb(x)")] {
+        let mut evaluator = BlockEvaluator::new(Expression::new(formula, s.clone()).unwrap());
+        group.bench_function(name, |b| {
+            b.iter(|| evaluator.eval_batch(&[(x_id, &x)], &mut out))
+        });
+    }
+    group.finish();
+}
+
+fn batch(c: &mut Criterion) {
+    let mut group = c.benchmark_group("batch");
+    let n = 100_000;
+    let x = column(n, -PI);
+    let y = column(n, 1.);
+    let mut out = vec![0.; n];
+    group.throughput(Throughput::Elements(n as u64));
+    let (s, x_id, y_id) = symbols();
+    let columns = [(x_id, &x[..]), (y_id, &y[..])];
+
+    let mut expr = Expression::new(MEDIUM_FORMULA, s.clone()).unwrap();
+    group.bench_function("value", |b| {
+        b.iter(|| {
+            for i in 0..n {
+                *expr.symbols_mut().value_mut(x_id) = x[i];
+                *expr.symbols_mut().value_mut(y_id) = y[i];
+                out[i] = expr.value();
+            }
+        })
+    });
+    group.bench_function("eval_batch", |b| {
+        b.iter(|| expr.eval_batch(&columns, &mut out))
+    });
+    let mut evaluator = BlockEvaluator::new(Expression::new(MEDIUM_FORMULA, s).unwrap());
+    group.bench_function("block_eval", |b| {
+        b.iter(|| evaluator.eval_batch(&columns, &mut out))
+    });
+
+    let x32: Vec<f32> = x.iter().map(|&v| v as f32).collect();
+    let y32: Vec<f32> = y.iter().map(|&v| v as f32).collect();
+    let mut out32 = vec![0f32; n];
+    let columns32 = [(x_id, &x32[..]), (y_id, &y32[..])];
+    group.bench_function("eval_batch_f32", |b| {
+        b.iter(|| expr.eval_batch_f32(&columns32, &mut out32))
+    });
+    group.bench_function("block_eval_f32", |b| {
+        b.iter(|| evaluator.eval_batch_f32(&columns32, &mut out32))
+    });
+    group.finish();
+}
+
+#[cfg(feature = "parallel")]
+fn threads(c: &mut Criterion) {
+    let mut group = c.benchmark_group("threads");
+    let n = 1_000_000;
+    let x = column(n, -PI);
+    let y = column(n, 1.);
+    let mut out = vec![0.; n];
+    group.throughput(Throughput::Elements(n as u64));
+    let (s, x_id, y_id) = symbols();
+    let columns = [(x_id, &x[..]), (y_id, &y[..])];
+    let expr = Expression::new(MEDIUM_FORMULA, s).unwrap();
+
+    for &n_threads in &[1, 2, 4, 8] {
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(n_threads)
+            .build()
+            .unwrap();
+        let evaluator = pool.install(|| ParallelEvaluator::with_instances(expr.clone(), n_threads));
+        group.bench_function(BenchmarkId::new("parallel_eval", n_threads), |b| {
+            b.iter(|| pool.install(|| evaluator.eval_batch(&columns, &mut out)))
+        });
+    }
+    // the instances are cloned from the compiled expression
+    group.bench_function("parallel_setup", |b| {
+        b.iter_batched(
+            || expr.clone(),
+            |e| ParallelEvaluator::with_instances(e, 8),
+            BatchSize::SmallInput,
+        )
+    });
+
+    let formulas: Vec<_> = (0..1000)
+        .map(|i| format!("{} + {}", MEDIUM_FORMULA, i))
+        .collect();
+    let (s, _, _) = symbols();
+    group.throughput(Throughput::Elements(formulas.len() as u64));
+    group.bench_function("compile_serial", |b| {
+        b.iter(|| {
+            formulas
+                .iter()
+                .map(|f| Expression::new(f, s.clone()))
+                .collect::<Vec<_>>()
+        })
+    });
+    group.bench_function("compile_many", |b| b.iter(|| compile_many(&formulas, &s)));
+    group.finish();
+}
+
+#[cfg(not(feature = "parallel"))]
+fn threads(_: &mut Criterion) {}
+
+#[cfg(feature = "arrow")]
+fn arrow(c: &mut Criterion) {
+    use arrow::array::{ArrayRef, Float32Array, Float64Array};
+    use arrow::datatypes::{DataType, Field, Schema};
+    use arrow::record_batch::RecordBatch;
+    use std::sync::Arc;
+
+    let mut group = c.benchmark_group("arrow");
+    let n = 1_000_000;
+    let batch_len = 65536;
+    let x = column(n, -PI);
+    let y = column(n, 1.);
+    group.throughput(Throughput::Elements(n as u64));
+
+    for &(name, ref dtype) in &[("f64", DataType::Float64), ("f32", DataType::Float32)] {
+        let schema = Arc::new(Schema::new(vec![
+            Field::new("x", dtype.clone(), true),
+            Field::new("y", dtype.clone(), true),
+        ]));
+        let batches: Vec<_> = x
+            .chunks(batch_len)
+            .zip(y.chunks(batch_len))
+            .map(|(x, y)| {
+                let to_array = |v: &[f64]| -> ArrayRef {
+                    if *dtype == DataType::Float64 {
+                        Arc::new(Float64Array::from(v.to_vec()))
+                    } else {
+                        Arc::new(Float32Array::from(
+                            v.iter().map(|&v| v as f32).collect::<Vec<_>>(),
+                        ))
+                    }
+                };
+                RecordBatch::try_new(schema.clone(), vec![to_array(x), to_array(y)]).unwrap()
+            })
+            .collect();
+        let mut s = SymbolTable::new();
+        s.add_pi();
+        let mut evaluator = ArrowEvaluator::with_symbols(MEDIUM_FORMULA, s, &schema).unwrap();
+        group.bench_function(BenchmarkId::new("record_batches", name), |b| {
+            b.iter(|| {
+                for batch in &batches {
+                    black_box(evaluator.evaluate(batch).unwrap());
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+#[cfg(not(feature = "arrow"))]
+fn arrow(_: &mut Criterion) {}
+
+criterion_group!(
+    benches,
+    compile,
+    clone,
+    resolver,
+    strings_vectors,
+    functions,
+    batch,
+    threads,
+    arrow
+);
+criterion_main!(benches);
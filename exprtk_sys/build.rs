@@ -1,3 +1,6 @@
+use std::env;
+use std::fs;
+
 fn main() {
     let mut c = cc::Build::new();
 
@@ -40,4 +43,29 @@ fn main() {
     }
 
     c.compile("libexprtk.a");
+
+    // Identifies the ExprTk revision and feature set, so that data depending
+    // on the compiled library can be checked for compatibility
+    let mut hash = fnv1a(
+        0xcbf2_9ce4_8422_2325,
+        &env::var("CARGO_PKG_VERSION").unwrap(),
+    );
+    if let Ok(header) = fs::read("cpp/exprtk/exprtk.hpp") {
+        hash = fnv1a(hash, &header);
+    }
+    let mut features: Vec<_> = env::vars()
+        .map(|(k, _)| k)
+        .filter(|k| k.starts_with("CARGO_FEATURE_"))
+        .collect();
+    features.sort();
+    hash = fnv1a(hash, &features.join(","));
+    println!("cargo:rustc-env=EXPRTK_BUILD_ID={:016x}", hash);
+}
+
+fn fnv1a<B: AsRef<[u8]>>(mut hash: u64, bytes: B) -> u64 {
+    for &b in bytes.as_ref() {
+        hash ^= u64::from(b);
+        hash = hash.wrapping_mul(0x0100_0000_01b3);
+    }
+    hash
 }
@@ -1,32 +1,219 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+
 #include "exprtk/exprtk.hpp"
 
 // helpers
 
-char *string_to_cstr(const std::string &s) {
-  char *pc = new char[s.size() + 1];
-  std::strcpy(pc, s.c_str());
-  return pc;
+// Borrowed view of a string owned by C++
+struct str_view {
+  const char *data;
+  size_t len;
+};
+
+str_view to_str_view(const std::string &s) {
+  str_view out;
+  out.data = s.data();
+  out.len = s.size();
+  return out;
 }
 
-struct cstr_list {
-  size_t size;
-  char **elements;
+// Callback receiving string views, which are only valid during the call
+typedef void (*str_callback)(void *, const char *, size_t);
+
+void strings_to_callback(const std::vector<std::string> &v, str_callback cb,
+                         void *user_data) {
+  for (size_t i = 0; i < v.size(); i++) {
+    cb(user_data, v[i].data(), v[i].size());
+  }
+}
+
+// ExprTk functions have side effects by default
+void set_side_effects(exprtk::function_traits &f, bool side_effects) {
+  if (side_effects) {
+    exprtk::enable_has_side_effects(f);
+  } else {
+    exprtk::disable_has_side_effects(f);
+  }
+}
+
+// Evaluation budgets (see expression_value_budget())
+
+// Limits for one evaluation, shared with Rust. The iteration count includes
+// the iterations of all loops of the expression.
+struct eval_budget {
+  uint64_t max_iterations; // zero: unlimited
+  uint64_t iterations;     // counted during the evaluation
+  uint64_t timeout_ns;     // zero: no deadline
+  const std::atomic<bool> *cancel; // may be NULL
+  int status;              // budget_status, set by expression_value_budget()
+};
+
+enum budget_status {
+  budget_ok = 0,
+  budget_iterations = 1,
+  budget_timeout = 2,
+  budget_cancelled = 3
+};
+
+// The clock is only read every few iterations
+const uint64_t BUDGET_CLOCK_INTERVAL = 1024;
+
+struct budget_exceeded {};
+
+struct budget_scope;
+thread_local budget_scope *active_budget = NULL;
+
+// The budget of the evaluation running on this thread. A scope without a
+// budget (NULL) suspends the enclosing one: it is opened by all evaluations
+// without a budget and around all calls into Rust, so that budget_exceeded
+// is never thrown through Rust frames.
+struct budget_scope {
+  eval_budget *budget;
+  std::chrono::steady_clock::time_point deadline;
+  budget_scope *prev;
+
+  budget_scope(eval_budget *b) : budget(b), prev(active_budget) {
+    if (b != NULL && b->timeout_ns > 0) {
+      deadline = std::chrono::steady_clock::now() +
+                 std::chrono::nanoseconds(b->timeout_ns);
+    }
+    active_budget = b != NULL ? this : NULL;
+  }
+  ~budget_scope() { active_budget = prev; }
+
+  // Stops the evaluation by unwinding to expression_value_budget()
+  void exceeded(budget_status status) {
+    budget->status = status;
+    throw budget_exceeded();
+  }
+
+  void check() {
+    eval_budget *b = budget;
+    b->iterations++;
+    if (b->max_iterations > 0 && b->iterations > b->max_iterations) {
+      exceeded(budget_iterations);
+    }
+    if (b->cancel != NULL && b->cancel->load(std::memory_order_relaxed)) {
+      exceeded(budget_cancelled);
+    }
+    if (b->timeout_ns > 0 && b->iterations % BUDGET_CLOCK_INTERVAL == 0 &&
+        std::chrono::steady_clock::now() >= deadline) {
+      exceeded(budget_timeout);
+    }
+  }
 };
 
-cstr_list *strings_to_cstr_list(const std::vector<std::string> &v) {
-  cstr_list *out = new cstr_list;
-  out->size = v.size();
-  out->elements = new char *[out->size];
+// Registered with parsers created with the loop_budget setting, whose loops
+// are compiled with a runtime check. Outside of expression_value_budget(), a
+// check only reads the thread-local budget pointer.
+struct loop_budget_check : exprtk::loop_runtime_check {
+  loop_budget_check() {
+    loop_set = e_all_loops;
+    // the per-loop limit of ExprTk is not used
+    max_loop_iterations =
+        std::numeric_limits<exprtk::details::_uint64_t>::max();
+  }
 
-  for (size_t i = 0; i < out->size; i++) {
-    out->elements[i] = string_to_cstr(v[i]);
+  virtual bool check() {
+    if (active_budget != NULL) {
+      active_budget->check();
+    }
+    return true;
   }
+};
 
-  return out;
-}
+// referenced by the loop nodes of expressions compiled with loop checks
+loop_budget_check loop_check;
+
+// Stops compiling after a timeout (ExprTk calls continue_compilation()
+// repeatedly while parsing)
+struct compile_timer : exprtk::compilation_check {
+  uint64_t timeout_ns;
+  std::chrono::steady_clock::time_point deadline;
+
+  compile_timer() : timeout_ns(0) {}
+
+  void start() {
+    deadline = std::chrono::steady_clock::now() +
+               std::chrono::nanoseconds(timeout_ns);
+  }
+
+  virtual bool continue_compilation(compilation_context &context) {
+    if (std::chrono::steady_clock::now() < deadline) {
+      return true;
+    }
+    context.error_message = "Compilation timeout";
+    return false;
+  }
+};
 
 extern "C" void free_rust_cstring(char *s);
 
+// Parser with some state that is reused between compilations
+template <typename T> struct parser_wrapper {
+  exprtk::parser<T> parser;
+  // the formula (compile() requires an std::string)
+  std::string formula;
+  // the first error and the number of tokens of the last compilation,
+  // parser_error() returns views to the error
+  bool has_error;
+  exprtk::parser_error::type error;
+  std::string error_token_type;
+  size_t token_count;
+  // compiled after each formula (see release_symbols())
+  exprtk::expression<T> blank;
+  // variables created by parser_compile_auto_vars(): names (each followed
+  // by a null byte) and pointers to their values
+  std::vector<std::string> resolved;
+  std::string resolved_names;
+  std::vector<T *> resolved_refs;
+  compile_timer timer;
+
+  parser_wrapper() : has_error(false), token_count(0) {}
+  parser_wrapper(const typename exprtk::parser<T>::settings_t &settings,
+                 uint64_t compile_timeout_ns, bool loop_budget)
+      : parser(settings), has_error(false), token_count(0) {
+    if (loop_budget) {
+      parser.register_loop_runtime_check(loop_check);
+    }
+    if (compile_timeout_ns > 0) {
+      timer.timeout_ns = compile_timeout_ns;
+      parser.register_compilation_timeout_check(timer);
+    }
+  }
+
+  // Compiles `formula`
+  bool compile(exprtk::expression<T> &e) {
+    if (timer.timeout_ns > 0) {
+      timer.start();
+    }
+    bool ok = parser.compile(formula, e);
+    token_count = parser.lexer().size();
+    has_error = parser.error_count() > 0;
+    if (has_error) {
+      // get_error() returns a copy
+      error = parser.get_error(0);
+      error_token_type = exprtk::lexer::token::to_str(error.token.type);
+    }
+    release_symbols();
+    return ok;
+  }
+
+  // The parser keeps copies of the symbol table handles of the last compiled
+  // expression until the next compilation. Their reference count is not
+  // atomic, so they are released right away by compiling a constant into an
+  // expression without symbol tables. Afterwards, the compiled expression
+  // can be moved to another thread.
+  void release_symbols() {
+    timer.deadline = std::chrono::steady_clock::time_point::max();
+    parser.compile("0", blank);
+  }
+};
+
 // for resolving unknown variables
 template <typename T>
 struct symbol_resolver : exprtk::parser<T>::unknown_symbol_resolver {
@@ -48,6 +235,7 @@ struct symbol_resolver : exprtk::parser<T>::unknown_symbol_resolver {
     // -> simplify things by ignoring this parameter
     (void)symbol_table;
 
+    budget_scope no_budget(NULL);
     char *msg = (*callback)(unknown_symbol.c_str(), user_data);
 
     if (msg != NULL) {
@@ -60,76 +248,173 @@ struct symbol_resolver : exprtk::parser<T>::unknown_symbol_resolver {
   }
 };
 
+// Creates unknown symbols as variables initialized with zero (the default
+// mode of ExprTk), and records their names
+template <typename T>
+struct var_collector : exprtk::parser<T>::unknown_symbol_resolver {
+  typedef typename exprtk::parser<T>::unknown_symbol_resolver usr_t;
+  using usr_t::process;
+  std::vector<std::string> *names;
+
+  var_collector(std::vector<std::string> *n) : names(n) {}
+
+  virtual bool process(const std::string &unknown_symbol,
+                       typename usr_t::usr_symbol_type &st, T &default_value,
+                       std::string &error_message) {
+    if (!usr_t::process(unknown_symbol, st, default_value, error_message)) {
+      return false;
+    }
+    names->push_back(unknown_symbol);
+    return true;
+  }
+};
+
+// Evaluates an expression for every row of columnar input, which may have
+// another type than the expression (see expression_value_batch())
+template <typename T, typename C>
+void value_batch(exprtk::expression<T> &e, T *const *vars,
+                 const C *const *columns, size_t n_vars, size_t n_rows,
+                 C *out) {
+  budget_scope no_budget(NULL);
+  for (size_t row = 0; row < n_rows; row++) {
+    for (size_t j = 0; j < n_vars; j++) {
+      *vars[j] = static_cast<T>(columns[j][row]);
+    }
+    out[row] = static_cast<C>(e.value());
+  }
+}
+
 // these methods don't depend on a specific precision
 
 extern "C" {
-typedef exprtk::parser<double> Parser;
+typedef parser_wrapper<double> Parser;
 typedef symbol_resolver<double> UnknownSymbolResolver;
 typedef exprtk::symbol_table<double> SymbolTable;
 typedef exprtk::expression<double> Expression;
+typedef exprtk::vector_view<double> VectorView;
 
 // Parser
 
 Parser *parser_new() { return new Parser; }
 
+// Settings (see exprtk::parser::settings_store), limits of zero keep the
+// defaults of ExprTk
+struct parser_settings {
+  size_t compile_options;
+  size_t max_stack_depth;
+  size_t max_node_depth;
+  // zero: no timeout
+  uint64_t compile_timeout_ns;
+  // compile loops with a check of the evaluation budget
+  bool loop_budget;
+};
+
+Parser *parser_new_with_settings(const parser_settings *s) {
+  exprtk::parser<double>::settings_t settings(s->compile_options);
+  if (s->max_stack_depth > 0) {
+    settings.set_max_stack_depth(s->max_stack_depth);
+  }
+  if (s->max_node_depth > 0) {
+    settings.set_max_node_depth(s->max_node_depth);
+  }
+  return new Parser(settings, s->compile_timeout_ns, s->loop_budget);
+}
+
 void parser_destroy(Parser *p) { delete p; }
 
-bool parser_compile(Parser *p, const char *s, Expression *e) {
-  return p->compile((const std::string &)s, *e);
+// The formula is copied into a buffer owned by the parser, which
+// only needs to grow if a formula is longer than all previous ones.
+bool parser_compile(Parser *p, const char *s, size_t len, Expression *e) {
+  p->formula.assign(s, len);
+  return p->compile(*e);
 }
 
-bool parser_compile_resolve(Parser *p, const char *s, Expression *e,
-                            char *(*cb)(const char *, void *),
+bool parser_compile_resolve(Parser *p, const char *s, size_t len,
+                            Expression *e, char *(*cb)(const char *, void *),
                             void *user_data) {
 
   UnknownSymbolResolver resolver(cb, user_data);
 
-  p->enable_unknown_symbol_resolver(&resolver);
+  p->parser.enable_unknown_symbol_resolver(&resolver);
 
-  bool ok = p->compile((const std::string &)s, *e);
+  p->formula.assign(s, len);
+  bool ok = p->compile(*e);
 
-  p->disable_unknown_symbol_resolver();
+  p->parser.disable_unknown_symbol_resolver();
 
   return ok;
 }
 
+// Variables created by parser_compile_auto_vars(), owned by the parser
+// until the next compilation
+struct resolved_vars {
+  // names, each followed by a null byte
+  str_view names;
+  double *const *refs;
+  size_t count;
+};
+
+// Compiles, creating unknown symbols as variables with value 0 without
+// calling back into Rust. All names and value pointers are returned at once.
+bool parser_compile_auto_vars(Parser *p, const char *s, size_t len,
+                              Expression *e, resolved_vars *out) {
+  p->resolved.clear();
+  var_collector<double> resolver(&p->resolved);
+
+  p->parser.enable_unknown_symbol_resolver(&resolver);
+
+  p->formula.assign(s, len);
+  bool ok = p->compile(*e);
+
+  p->parser.disable_unknown_symbol_resolver();
+
+  if (!ok) {
+    return false;
+  }
+
+  SymbolTable &t = e->get_symbol_table(0);
+  p->resolved_names.clear();
+  p->resolved_refs.clear();
+  for (size_t i = 0; i < p->resolved.size(); i++) {
+    p->resolved_names.append(p->resolved[i]);
+    p->resolved_names.push_back('\0');
+    p->resolved_refs.push_back(&t.variable_ref(p->resolved[i]));
+  }
+  out->names = to_str_view(p->resolved_names);
+  out->refs = p->resolved_refs.data();
+  out->count = p->resolved.size();
+  return true;
+}
+
 struct parser_err {
   bool is_err;
   int mode;
-  const char *token_type;
-  const char *token_value;
-  // const char* mode;
-  const char *diagnostic;
-  const char *error_line;
+  str_view token_type;
+  str_view token_value;
+  str_view diagnostic;
+  str_view error_line;
   size_t line_no;
   size_t column_no;
 };
 
-parser_err *parser_error(Parser *p) {
-  // TODO: it seems p->get_error(0) creates a copy of the error (why?)
-  // therefore we have to heap allocate the output
-  parser_err *out = new parser_err;
-  if (p->error_count() > 0) {
-    out->is_err = true;
-    exprtk::parser_error::type err = p->get_error(0);
-    out->mode = err.mode;
-    out->token_type =
-        string_to_cstr(exprtk::lexer::token::to_str(err.token.type));
-    out->token_value = string_to_cstr(err.token.value);
-    out->diagnostic = string_to_cstr(err.diagnostic);
-    out->error_line = string_to_cstr(err.error_line);
-    out->line_no = err.line_no;
-    out->column_no = err.column_no;
+// Number of tokens of the last compiled formula
+size_t parser_token_count(Parser *p) { return p->token_count; }
+
+// Fills the caller-provided struct with the first error of the last
+// compilation. The string views point to memory owned by the parser, which
+// stays valid until the next compilation.
+bool parser_error(Parser *p, parser_err *out) {
+  out->is_err = p->has_error;
+  if (out->is_err) {
+    out->mode = p->error.mode;
+    out->token_type = to_str_view(p->error_token_type);
+    out->token_value = to_str_view(p->error.token.value);
+    out->diagnostic = to_str_view(p->error.diagnostic);
+    out->error_line = to_str_view(p->error.error_line);
+    out->line_no = p->error.line_no;
+    out->column_no = p->error.column_no;
   }
-  return out;
-}
-
-void parser_error_free(parser_err *e) {
-  delete[] e->token_type;
-  delete[] e->token_value;
-  delete[] e->diagnostic;
-  delete[] e->error_line;
-  delete e;
+  return out->is_err;
 }
 
 // String values: Rust cannot deal with C++ strings by itself
@@ -138,60 +423,81 @@ std::string *cpp_string_create(const char *s, size_t len) {
   return new std::string(s, len);
 }
 
+// Does not allocate if the length does not exceed the capacity
 void cpp_string_set(std::string *s, const char *replacement, size_t len) {
   s->assign(replacement, len);
 }
 
-const char *cpp_string_get(const std::string *s) { return s->c_str(); }
+void cpp_string_reserve(std::string *s, size_t capacity) {
+  s->reserve(capacity);
+}
+
+size_t cpp_string_capacity(const std::string *s) { return s->capacity(); }
+
+str_view cpp_string_data(const std::string *s) { return to_str_view(*s); }
 
 void cpp_string_free(std::string *s) { delete s; }
 
 // Symbol table
 
+// Names are passed as (pointer, length) and are not NUL-terminated
+
 SymbolTable *symbol_table_new() { return new SymbolTable; }
 
 void symbol_table_destroy(SymbolTable *t) { delete t; }
 
-bool symbol_table_add_variable(SymbolTable *t, char *variable_name,
-                               double *value, bool is_constant = false) {
-  return t->add_variable(std::string(variable_name), *value, is_constant);
+bool symbol_table_add_variable(SymbolTable *t, const char *name,
+                               size_t name_len, double *value,
+                               bool is_constant = false) {
+  return t->add_variable(std::string(name, name_len), *value, is_constant);
+}
+
+bool symbol_table_create_variable(SymbolTable *t, const char *name,
+                                  size_t name_len, const double value) {
+  return t->create_variable(std::string(name, name_len), value);
 }
 
-bool symbol_table_create_variable(SymbolTable *t, char *variable_name,
-                                  const double value) {
-  return t->create_variable(std::string(variable_name), value);
+bool symbol_table_add_constant(SymbolTable *t, const char *name,
+                               size_t name_len, const double value) {
+  return t->add_constant(std::string(name, name_len), value);
 }
 
-bool symbol_table_add_constant(SymbolTable *t, char *variable_name,
-                               const double value) {
-  return t->add_constant(std::string(variable_name), value);
+bool symbol_table_add_stringvar(SymbolTable *t, const char *name,
+                                size_t name_len, std::string *string,
+                                bool is_const) {
+  return t->add_stringvar(std::string(name, name_len), *string, is_const);
 }
 
-bool symbol_table_add_stringvar(SymbolTable *t, char *variable_name,
-                                std::string *string, bool is_const) {
-  return t->add_stringvar(std::string(variable_name), *string, is_const);
+bool symbol_table_create_stringvar(SymbolTable *t, const char *name,
+                                   size_t name_len, const char *string,
+                                   size_t string_len) {
+  return t->create_stringvar(std::string(name, name_len),
+                             std::string(string, string_len));
 }
 
-bool symbol_table_create_stringvar(SymbolTable *t, char *variable_name,
-                                   char *string) {
-  return t->create_stringvar(std::string(variable_name), std::string(string));
+bool symbol_table_add_vector(SymbolTable *t, const char *name,
+                             size_t name_len, double *vec, const size_t len) {
+  return t->add_vector(std::string(name, name_len), vec, len);
 }
 
-bool symbol_table_add_vector(SymbolTable *t, char *name, double *vec,
-                             const size_t len) {
-  return t->add_vector(std::string(name), vec, len);
+bool symbol_table_add_vector_view(SymbolTable *t, const char *name,
+                                  size_t name_len, VectorView *v) {
+  return t->add_vector(std::string(name, name_len), *v);
 }
 
-bool symbol_table_remove_variable(SymbolTable *t, char *name) {
-  return t->remove_variable(std::string(name), true);
+bool symbol_table_remove_variable(SymbolTable *t, const char *name,
+                                  size_t name_len) {
+  return t->remove_variable(std::string(name, name_len), true);
 }
 
-bool symbol_table_remove_stringvar(SymbolTable *t, char *name) {
-  return t->remove_stringvar(std::string(name));
+bool symbol_table_remove_stringvar(SymbolTable *t, const char *name,
+                                   size_t name_len) {
+  return t->remove_stringvar(std::string(name, name_len));
 }
 
-bool symbol_table_remove_vector(SymbolTable *t, char *name) {
-  return t->remove_vector(std::string(name));
+bool symbol_table_remove_vector(SymbolTable *t, const char *name,
+                                size_t name_len) {
+  return t->remove_vector(std::string(name, name_len));
 }
 
 void symbol_table_clear_variables(SymbolTable *t) { t->clear_variables(true); }
@@ -206,17 +512,20 @@ void symbol_table_clear_local_constants(SymbolTable *t) {
 
 void symbol_table_clear_functions(SymbolTable *t) { t->clear_functions(); }
 
-double *symbol_table_variable_ref(SymbolTable *t, char *variable_name) {
-  return &t->variable_ref(std::string(variable_name));
+double *symbol_table_variable_ref(SymbolTable *t, const char *name,
+                                  size_t name_len) {
+  return &t->variable_ref(std::string(name, name_len));
 }
 
-std::string *symbol_table_stringvar_ref(SymbolTable *t, char *variable_name) {
-  return &t->stringvar_ref(std::string(variable_name));
+std::string *symbol_table_stringvar_ref(SymbolTable *t, const char *name,
+                                        size_t name_len) {
+  return &t->stringvar_ref(std::string(name, name_len));
 }
 
-const double *symbol_table_vector_ptr(SymbolTable *t, char *variable_name) {
+const double *symbol_table_vector_ptr(SymbolTable *t, const char *name,
+                                      size_t name_len) {
   exprtk::symbol_table<double>::vector_holder_ptr v =
-      t->get_vector(std::string(variable_name));
+      t->get_vector(std::string(name, name_len));
   if (v != NULL) {
     return (double *)v->data();
   } else {
@@ -246,43 +555,42 @@ bool symbol_table_add_epsilon(SymbolTable *t) { return t->add_epsilon(); }
 
 bool symbol_table_add_infinity(SymbolTable *t) { return t->add_infinity(); }
 
-bool symbol_table_is_constant_node(SymbolTable *t, char *name) {
-  return t->is_constant_node(std::string(name));
+bool symbol_table_is_constant_node(SymbolTable *t, const char *name,
+                                   size_t name_len) {
+  return t->is_constant_node(std::string(name, name_len));
 }
 
-bool symbol_table_is_constant_string(SymbolTable *t, char *name) {
-  return t->is_constant_string(std::string(name));
+bool symbol_table_is_constant_string(SymbolTable *t, const char *name,
+                                     size_t name_len) {
+  return t->is_constant_string(std::string(name, name_len));
 }
 
-cstr_list *symbol_table_get_variable_list(SymbolTable *t) {
+// The names are passed to the callback one by one
+
+void symbol_table_get_variable_list(SymbolTable *t, str_callback cb,
+                                    void *user_data) {
   std::vector<std::string> vlist;
   t->get_variable_list(vlist);
-  return strings_to_cstr_list(vlist);
+  strings_to_callback(vlist, cb, user_data);
 }
 
-cstr_list *symbol_table_get_stringvar_list(SymbolTable *t) {
+void symbol_table_get_stringvar_list(SymbolTable *t, str_callback cb,
+                                     void *user_data) {
   std::vector<std::string> slist;
   t->get_stringvar_list(slist);
-  return strings_to_cstr_list(slist);
+  strings_to_callback(slist, cb, user_data);
 }
 
-cstr_list *symbol_table_get_vector_list(SymbolTable *t) {
+void symbol_table_get_vector_list(SymbolTable *t, str_callback cb,
+                                  void *user_data) {
   std::vector<std::string> vlist;
   t->get_vector_list(vlist);
-  return strings_to_cstr_list(vlist);
-}
-
-void string_array_free(cstr_list *c) {
-  int n = c->size;
-  for (int i = 0; i < n; i++) {
-    delete[] c->elements[i];
-  }
-  delete[] c->elements;
-  delete c;
+  strings_to_callback(vlist, cb, user_data);
 }
 
-bool symbol_table_symbol_exists(SymbolTable *t, char *variable_name) {
-  return t->symbol_exists(std::string(variable_name));
+bool symbol_table_symbol_exists(SymbolTable *t, const char *name,
+                                size_t name_len) {
+  return t->symbol_exists(std::string(name, name_len));
 }
 
 bool symbol_table_valid(SymbolTable *t) { return t->valid(); }
@@ -291,6 +599,22 @@ void symbol_table_load_from(SymbolTable *t, const SymbolTable *other) {
   t->load_from(*other);
 }
 
+// Vector views: vectors referring to memory owned by the caller, which
+// can be pointed to a different buffer after compilation
+
+VectorView *vector_view_new(double *data, size_t len) {
+  return new VectorView(data, len);
+}
+
+void vector_view_rebase(VectorView *v, double *data) { v->rebase(data); }
+
+// The new size must not be larger than the initial size
+bool vector_view_set_size(VectorView *v, size_t len) {
+  return v->set_size(len);
+}
+
+void vector_view_destroy(VectorView *v) { delete v; }
+
 // functions
 
 struct func_result {
@@ -324,28 +648,31 @@ struct func_result {
 
 // Implementing exprtk::ifunction with different No of arguments
 // and providing FFI functions for Rust
-// The functions are assumed to have no side effects (not Fn() closures in Rust)
+// Functions without side effects are folded by the optimizer if all arguments
+// are constant.
 #define FUNC_DEF(T, N)                                                         \
   struct var##N##_func : public exprtk::ifunction<double> {                    \
     double (*cb)(void *, REPEAT(N, SIMPLE, T));                                \
     void *user_data;                                                           \
-    var##N##_func(double (*c)(void *, REPEAT(N, SIMPLE, T)), void *d)          \
+    var##N##_func(bool side_effects,                                           \
+                  double (*c)(void *, REPEAT(N, SIMPLE, T)), void *d)          \
         : exprtk::ifunction<double>(N) {                                       \
       cb = c;                                                                  \
       user_data = d;                                                           \
-      exprtk::disable_has_side_effects(*this);                                 \
+      set_side_effects(*this, side_effects);                                   \
     }                                                                          \
     double operator()(REPEAT(N, NUMBERED, const double &arg_)) {               \
+      budget_scope no_budget(NULL);                                            \
       return cb(user_data, REPEAT(N, NUMBERED, arg_));                         \
     }                                                                          \
   };                                                                           \
                                                                                \
   func_result symbol_table_add_func##N(                                        \
-      SymbolTable *t, char *name, double (*cb)(void *, REPEAT(N, SIMPLE, T)),  \
-      void *user_data) {                                                       \
-    var##N##_func *f = new var##N##_func(cb, user_data);                       \
+      SymbolTable *t, const char *name, size_t name_len, bool side_effects,    \
+      double (*cb)(void *, REPEAT(N, SIMPLE, T)), void *user_data) {           \
+    var##N##_func *f = new var##N##_func(side_effects, cb, user_data);         \
     func_result out;                                                           \
-    std::string name_s = std::string(name);                                    \
+    std::string name_s = std::string(name, name_len);                          \
     out.res = t->add_function(name_s, *f);                                     \
     if (!out.res) {                                                            \
       delete f;                                                                \
@@ -368,6 +695,152 @@ FUNC_DEF(double, 8);
 FUNC_DEF(double, 9);
 FUNC_DEF(double, 10);
 
+// Function with N arguments (N <= 10), which are passed to the callback as
+// an array. On the Rust side, the same callback also handles whole blocks
+// of values (see BlockEvaluator).
+#define VEC_FUNC_OP(N)                                                         \
+  double operator()(REPEAT(N, NUMBERED, const double &arg_)) {                 \
+    const double args[] = {REPEAT(N, NUMBERED, arg_)};                         \
+    budget_scope no_budget(NULL);                                              \
+    return cb(user_data, args, N);                                             \
+  }
+
+struct vec_func : public exprtk::ifunction<double> {
+  double (*cb)(void *, const double *, size_t);
+  void *user_data;
+  vec_func(size_t n, double (*c)(void *, const double *, size_t), void *d)
+      : exprtk::ifunction<double>(n) {
+    cb = c;
+    user_data = d;
+    exprtk::disable_has_side_effects(*this);
+  }
+  VEC_FUNC_OP(1)
+  VEC_FUNC_OP(2)
+  VEC_FUNC_OP(3)
+  VEC_FUNC_OP(4)
+  VEC_FUNC_OP(5)
+  VEC_FUNC_OP(6)
+  VEC_FUNC_OP(7)
+  VEC_FUNC_OP(8)
+  VEC_FUNC_OP(9)
+  VEC_FUNC_OP(10)
+};
+
+func_result symbol_table_add_vec_func(SymbolTable *t, const char *name,
+                                      size_t name_len, size_t n_args,
+                                      double (*cb)(void *, const double *,
+                                                   size_t),
+                                      void *user_data) {
+  vec_func *f = new vec_func(n_args, cb, user_data);
+  func_result out;
+  out.res = t->add_function(std::string(name, name_len), *f);
+  if (!out.res) {
+    delete f;
+  } else {
+    out.fn_pointer = (void *)f;
+  }
+  return out;
+}
+
+void symbol_table_free_vec_func(vec_func *f) { delete f; }
+
+// Variadic function, the arguments are passed to the callback as an array
+
+struct vararg_func : public exprtk::ivararg_function<double> {
+  double (*cb)(void *, const double *, size_t);
+  void *user_data;
+  vararg_func(bool side_effects, double (*c)(void *, const double *, size_t),
+              void *d) {
+    cb = c;
+    user_data = d;
+    set_side_effects(*this, side_effects);
+  }
+  double operator()(const std::vector<double> &args) {
+    budget_scope no_budget(NULL);
+    return cb(user_data, args.empty() ? NULL : &args[0], args.size());
+  }
+};
+
+func_result symbol_table_add_vararg_func(SymbolTable *t, const char *name,
+                                         size_t name_len, bool side_effects,
+                                         double (*cb)(void *, const double *,
+                                                      size_t),
+                                         void *user_data) {
+  vararg_func *f = new vararg_func(side_effects, cb, user_data);
+  func_result out;
+  out.res = t->add_function(std::string(name, name_len), *f);
+  if (!out.res) {
+    delete f;
+  } else {
+    out.fn_pointer = (void *)f;
+  }
+  return out;
+}
+
+void symbol_table_free_vararg_func(vararg_func *f) { delete f; }
+
+// Generic function with scalar, vector and string arguments. The parameter
+// list of ExprTk is passed to the callback as it is: generic_arg has the same
+// layout as exprtk::type_store, the data is not copied.
+
+typedef exprtk::igeneric_function<double>::generic_type generic_type;
+
+struct generic_arg {
+  void *data;
+  size_t size;
+  int type;
+};
+
+static_assert(sizeof(generic_arg) == sizeof(generic_type) &&
+                  offsetof(generic_arg, size) ==
+                      offsetof(generic_type, size) &&
+                  offsetof(generic_arg, type) ==
+                      offsetof(generic_type, type) &&
+                  sizeof(generic_type::store_type) == sizeof(int),
+              "generic_arg does not match exprtk::type_store");
+static_assert(generic_type::e_scalar == 1 && generic_type::e_vector == 2 &&
+                  generic_type::e_string == 3,
+              "unexpected exprtk::type_store::store_type values");
+
+struct generic_func : public exprtk::igeneric_function<double> {
+  double (*cb)(void *, const generic_arg *, size_t);
+  void *user_data;
+  generic_func(const std::string &param_seq, bool side_effects,
+               double (*c)(void *, const generic_arg *, size_t), void *d)
+      : exprtk::igeneric_function<double>(param_seq) {
+    cb = c;
+    user_data = d;
+    set_side_effects(*this, side_effects);
+  }
+  double operator()(parameter_list_t params) {
+    size_t n = params.size();
+    const generic_arg *args =
+        n == 0 ? NULL : reinterpret_cast<const generic_arg *>(&params[0]);
+    budget_scope no_budget(NULL);
+    return cb(user_data, args, n);
+  }
+};
+
+func_result
+symbol_table_add_generic_func(SymbolTable *t, const char *name,
+                              size_t name_len, const char *param_seq,
+                              size_t param_seq_len, bool side_effects,
+                              double (*cb)(void *, const generic_arg *, size_t),
+                              void *user_data) {
+  generic_func *f = new generic_func(std::string(param_seq, param_seq_len),
+                                     side_effects, cb, user_data);
+  func_result out;
+  out.res = t->add_function(std::string(name, name_len), *f);
+  if (!out.res) {
+    delete f;
+  } else {
+    out.fn_pointer = (void *)f;
+  }
+  return out;
+}
+
+void symbol_table_free_generic_func(generic_func *f) { delete f; }
+
 // Expression
 
 Expression *expression_new() { return new Expression; }
@@ -378,5 +851,38 @@ void expression_register_symbol_table(Expression *e, SymbolTable *t) {
   e->register_symbol_table(*t);
 }
 
-double expression_value(Expression *e) { return e->value(); }
+double expression_value(Expression *e) {
+  budget_scope no_budget(NULL);
+  return e->value();
+}
+
+// Evaluates the expression within the limits of the budget. If they are
+// exceeded, the evaluation stops with NaN and b->status is set accordingly.
+// Loop iterations are only counted in expressions compiled by the wrapper.
+double expression_value_budget(Expression *e, eval_budget *b) {
+  b->iterations = 0;
+  b->status = budget_ok;
+  budget_scope scope(b);
+  try {
+    return e->value();
+  } catch (const budget_exceeded &) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+// Evaluates the expression for n_rows rows of columnar input. Before each
+// evaluation, the variable vars[j] is set to columns[j][row].
+void expression_value_batch(Expression *e, double *const *vars,
+                            const double *const *columns, size_t n_vars,
+                            size_t n_rows, double *out) {
+  value_batch(*e, vars, columns, n_vars, n_rows, out);
+}
+
+// Same with single precision input and output, the values are converted
+// row by row
+void expression_value_batch_f32(Expression *e, double *const *vars,
+                                const float *const *columns, size_t n_vars,
+                                size_t n_rows, float *out) {
+  value_batch(*e, vars, columns, n_vars, n_rows, out);
+}
 }
@@ -3,6 +3,15 @@
 use libc::*;
 use std::ffi::CString;
 use std::slice;
+use std::sync::atomic::AtomicBool;
+
+/// Identifier of the ExprTk header revision and the enabled features this
+/// crate was built with
+pub const BUILD_ID: &str = env!("EXPRTK_BUILD_ID");
+
+/// `true` if ExprTk was built to ignore the case of symbol names
+/// (`caseinsensitivity` feature)
+pub const CASE_INSENSITIVE: bool = cfg!(feature = "caseinsensitivity");
 
 // types
 
@@ -10,32 +19,156 @@ pub enum CSymbolTable {}
 pub enum CExpression {}
 pub enum CParser {}
 pub enum CppString {}
+pub enum CVectorView {}
 
 // simple types used for communications with C++
 
 #[repr(C)]
 pub struct Pair<T, U>(pub T, pub U);
 
-pub type CStrList = Pair<size_t, *const *const c_char>;
+/// Borrowed view of a string owned by C++ (not NUL-terminated)
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct CStrView {
+    pub data: *const c_char,
+    pub len: size_t,
+}
 
-impl CStrList {
-    pub unsafe fn get_slice(&self) -> &[*const c_char] {
-        slice::from_raw_parts(self.1, self.0 as usize)
+impl CStrView {
+    pub const fn empty() -> CStrView {
+        CStrView {
+            data: 0 as *const c_char,
+            len: 0,
+        }
+    }
+
+    pub unsafe fn as_bytes(&self) -> &[u8] {
+        if self.len == 0 {
+            return &[];
+        }
+        slice::from_raw_parts(self.data as *const u8, self.len as usize)
     }
 }
 
+/// Callback receiving a string view, which is only valid during the call
+pub type CStrCallback = extern "C" fn(*mut c_void, *const c_char, size_t);
+
+/// Settings for `parser_new_with_settings`
+#[repr(C)]
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub struct CParserSettings {
+    /// Combination of the `COMPILE_*` flags
+    pub compile_options: size_t,
+    /// Zero keeps the ExprTk default
+    pub max_stack_depth: size_t,
+    /// Zero keeps the ExprTk default
+    pub max_node_depth: size_t,
+    /// Zero: no timeout
+    pub compile_timeout_ns: u64,
+    /// Compiles loops with a check of the budget of `expression_value_budget`
+    pub loop_budget: bool,
+}
+
+// Compile options (exprtk::parser::settings_store::settings_compile_options)
+pub const COMPILE_REPLACER: size_t = 1;
+pub const COMPILE_JOINER: size_t = 2;
+pub const COMPILE_NUMERIC_CHECK: size_t = 4;
+pub const COMPILE_BRACKET_CHECK: size_t = 8;
+pub const COMPILE_SEQUENCE_CHECK: size_t = 16;
+pub const COMPILE_COMMUTATIVE_CHECK: size_t = 32;
+pub const COMPILE_STRENGTH_REDUCTION: size_t = 64;
+pub const COMPILE_DISABLE_VARDEF: size_t = 128;
+/// Default of ExprTk (`compile_all_opts`)
+pub const COMPILE_ALL_OPTS: size_t = COMPILE_REPLACER
+    | COMPILE_JOINER
+    | COMPILE_NUMERIC_CHECK
+    | COMPILE_BRACKET_CHECK
+    | COMPILE_SEQUENCE_CHECK
+    | COMPILE_COMMUTATIVE_CHECK
+    | COMPILE_STRENGTH_REDUCTION;
+
+/// Argument of a generic function (same layout as `exprtk::type_store`)
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct CGenericArg {
+    pub data: *mut c_void,
+    pub size: size_t,
+    pub kind: c_int,
+}
+
+// Values of `CGenericArg::kind`
+pub const GENERIC_SCALAR: c_int = 1;
+pub const GENERIC_VECTOR: c_int = 2;
+pub const GENERIC_STRING: c_int = 3;
+
 #[repr(C)]
 pub struct CParseError {
     pub is_err: bool,
     pub mode: c_int,
-    pub token_type: *const c_char,
-    pub token_value: *const c_char,
-    pub diagnostic: *const c_char,
-    pub error_line: *const c_char,
+    pub token_type: CStrView,
+    pub token_value: CStrView,
+    pub diagnostic: CStrView,
+    pub error_line: CStrView,
     pub line_no: size_t,
     pub column_no: size_t,
 }
 
+impl CParseError {
+    pub const fn empty() -> CParseError {
+        CParseError {
+            is_err: false,
+            mode: 0,
+            token_type: CStrView::empty(),
+            token_value: CStrView::empty(),
+            diagnostic: CStrView::empty(),
+            error_line: CStrView::empty(),
+            line_no: 0,
+            column_no: 0,
+        }
+    }
+}
+
+/// Limits for `expression_value_budget`. The iteration count includes the
+/// iterations of all loops of the expression.
+#[repr(C)]
+pub struct CEvalBudget {
+    /// Zero: unlimited
+    pub max_iterations: u64,
+    /// Set by `expression_value_budget`
+    pub iterations: u64,
+    /// Zero: no deadline
+    pub timeout_ns: u64,
+    /// May be null
+    pub cancel: *const AtomicBool,
+    /// One of the `BUDGET_*` values, set by `expression_value_budget`
+    pub status: c_int,
+}
+
+// Values of `CEvalBudget::status`
+pub const BUDGET_OK: c_int = 0;
+pub const BUDGET_ITERATIONS: c_int = 1;
+pub const BUDGET_TIMEOUT: c_int = 2;
+pub const BUDGET_CANCELLED: c_int = 3;
+
+/// Variables created by `parser_compile_auto_vars`, borrowed from the parser
+#[repr(C)]
+pub struct CResolvedVars {
+    /// names, each followed by a null byte
+    pub names: CStrView,
+    pub refs: *const *mut c_double,
+    pub count: size_t,
+}
+
+impl CResolvedVars {
+    pub const fn empty() -> CResolvedVars {
+        CResolvedVars {
+            names: CStrView::empty(),
+            refs: 0 as *const *mut c_double,
+            count: 0,
+        }
+    }
+}
+
 // for deallocating CString from C
 #[no_mangle]
 pub unsafe extern "C" fn free_rust_cstring(s: *mut c_char) {
@@ -50,40 +183,65 @@ extern "C" {
     pub fn symbol_table_new() -> *mut CSymbolTable;
     pub fn symbol_table_add_variable(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         value: *const c_double,
         is_constant: bool,
     ) -> bool;
     pub fn symbol_table_add_constant(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         value: c_double,
     ) -> bool;
     pub fn symbol_table_create_variable(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         value: c_double,
     ) -> bool;
     pub fn symbol_table_add_stringvar(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         string: *mut CppString,
         is_const: bool,
     ) -> bool;
     pub fn symbol_table_create_stringvar(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         string: *const c_char,
+        string_len: size_t,
     ) -> bool;
     pub fn symbol_table_add_vector(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
         ptr: *const c_double,
         len: size_t,
     ) -> bool;
-    pub fn symbol_table_remove_variable(t: *mut CSymbolTable, name: *const c_char) -> bool;
-    pub fn symbol_table_remove_stringvar(t: *mut CSymbolTable, name: *const c_char) -> bool;
-    pub fn symbol_table_remove_vector(t: *mut CSymbolTable, name: *const c_char) -> bool;
+    pub fn symbol_table_add_vector_view(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+        view: *mut CVectorView,
+    ) -> bool;
+    pub fn symbol_table_remove_variable(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
+    pub fn symbol_table_remove_stringvar(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
+    pub fn symbol_table_remove_vector(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
     pub fn symbol_table_clear_variables(t: *mut CSymbolTable);
     pub fn symbol_table_clear_strings(t: *mut CSymbolTable);
     pub fn symbol_table_clear_vectors(t: *mut CSymbolTable);
@@ -91,15 +249,18 @@ extern "C" {
     pub fn symbol_table_clear_functions(t: *mut CSymbolTable);
     pub fn symbol_table_variable_ref(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
     ) -> *mut c_double;
     pub fn symbol_table_stringvar_ref(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
     ) -> *mut CppString;
     pub fn symbol_table_vector_ptr(
         t: *mut CSymbolTable,
-        variable_name: *const c_char,
+        name: *const c_char,
+        name_len: size_t,
     ) -> *const c_double;
     pub fn symbol_table_set_string(
         t: *mut CSymbolTable,
@@ -113,17 +274,46 @@ extern "C" {
     pub fn symbol_table_add_pi(t: *mut CSymbolTable) -> bool;
     pub fn symbol_table_add_epsilon(t: *mut CSymbolTable) -> bool;
     pub fn symbol_table_add_infinity(t: *mut CSymbolTable) -> bool;
-    pub fn symbol_table_get_variable_list(t: *mut CSymbolTable) -> *mut CStrList;
-    pub fn symbol_table_get_stringvar_list(t: *mut CSymbolTable) -> *mut CStrList; //StringPtrList;
-    pub fn symbol_table_get_vector_list(t: *mut CSymbolTable) -> *mut CStrList;
+    pub fn symbol_table_get_variable_list(
+        t: *mut CSymbolTable,
+        cb: CStrCallback,
+        user_data: *mut c_void,
+    );
+    pub fn symbol_table_get_stringvar_list(
+        t: *mut CSymbolTable,
+        cb: CStrCallback,
+        user_data: *mut c_void,
+    );
+    pub fn symbol_table_get_vector_list(
+        t: *mut CSymbolTable,
+        cb: CStrCallback,
+        user_data: *mut c_void,
+    );
     pub fn symbol_table_valid(t: *mut CSymbolTable) -> bool;
-    pub fn symbol_table_symbol_exists(t: *mut CSymbolTable, name: *const c_char) -> bool;
+    pub fn symbol_table_symbol_exists(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
     pub fn symbol_table_load_from(t: *mut CSymbolTable, other: *const CSymbolTable);
     pub fn symbol_table_add_constants(t: *mut CSymbolTable) -> bool;
-    pub fn symbol_table_is_constant_node(t: *mut CSymbolTable, name: *const c_char) -> bool;
-    pub fn symbol_table_is_constant_string(t: *mut CSymbolTable, name: *const c_char) -> bool;
+    pub fn symbol_table_is_constant_node(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
+    pub fn symbol_table_is_constant_string(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+    ) -> bool;
     pub fn symbol_table_destroy(t: *mut CSymbolTable);
 
+    pub fn vector_view_new(data: *mut c_double, len: size_t) -> *mut CVectorView;
+    pub fn vector_view_rebase(v: *mut CVectorView, data: *mut c_double);
+    pub fn vector_view_set_size(v: *mut CVectorView, len: size_t) -> bool;
+    pub fn vector_view_destroy(v: *mut CVectorView);
+
     // // blocked by #5668
     // macro_rules! func_declare {
     //     ($add_name:ident, $free_name:ident, $($ty:ty),*) => {
@@ -137,6 +327,8 @@ extern "C" {
     pub fn symbol_table_add_func1(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(*mut c_void, c_double) -> c_double,
         user_data: *mut c_void,
     ) -> Pair<bool, *mut c_void>;
@@ -145,6 +337,8 @@ extern "C" {
     pub fn symbol_table_add_func2(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(*mut c_void, c_double, c_double) -> c_double,
         user_data: *mut c_void,
     ) -> Pair<bool, *mut c_void>;
@@ -153,6 +347,8 @@ extern "C" {
     pub fn symbol_table_add_func3(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(*mut c_void, c_double, c_double, c_double) -> c_double,
         user_data: *mut c_void,
     ) -> Pair<bool, *mut c_void>;
@@ -161,6 +357,8 @@ extern "C" {
     pub fn symbol_table_add_func4(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(*mut c_void, c_double, c_double, c_double, c_double) -> c_double,
         user_data: *mut c_void,
     ) -> Pair<bool, *mut c_void>;
@@ -169,6 +367,8 @@ extern "C" {
     pub fn symbol_table_add_func5(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -184,6 +384,8 @@ extern "C" {
     pub fn symbol_table_add_func6(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -200,6 +402,8 @@ extern "C" {
     pub fn symbol_table_add_func7(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -217,6 +421,8 @@ extern "C" {
     pub fn symbol_table_add_func8(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -235,6 +441,8 @@ extern "C" {
     pub fn symbol_table_add_func9(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -254,6 +462,8 @@ extern "C" {
     pub fn symbol_table_add_func10(
         t: *mut CSymbolTable,
         name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
         cb: extern "C" fn(
             *mut c_void,
             c_double,
@@ -271,30 +481,93 @@ extern "C" {
     ) -> Pair<bool, *mut c_void>;
     pub fn symbol_table_free_func10(c_func: *mut c_void);
 
+    pub fn symbol_table_add_vec_func(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+        n_args: size_t,
+        cb: extern "C" fn(*mut c_void, *const c_double, size_t) -> c_double,
+        user_data: *mut c_void,
+    ) -> Pair<bool, *mut c_void>;
+    pub fn symbol_table_free_vec_func(c_func: *mut c_void);
+
+    pub fn symbol_table_add_vararg_func(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+        has_side_effects: bool,
+        cb: extern "C" fn(*mut c_void, *const c_double, size_t) -> c_double,
+        user_data: *mut c_void,
+    ) -> Pair<bool, *mut c_void>;
+    pub fn symbol_table_free_vararg_func(c_func: *mut c_void);
+
+    pub fn symbol_table_add_generic_func(
+        t: *mut CSymbolTable,
+        name: *const c_char,
+        name_len: size_t,
+        param_seq: *const c_char,
+        param_seq_len: size_t,
+        has_side_effects: bool,
+        cb: extern "C" fn(*mut c_void, *const CGenericArg, size_t) -> c_double,
+        user_data: *mut c_void,
+    ) -> Pair<bool, *mut c_void>;
+    pub fn symbol_table_free_generic_func(c_func: *mut c_void);
+
     // Expression
     pub fn expression_new() -> *mut CExpression;
     pub fn expression_register_symbol_table(e: *mut CExpression, t: *const CSymbolTable);
     pub fn expression_value(e: *mut CExpression) -> c_double;
+    pub fn expression_value_budget(e: *mut CExpression, b: *mut CEvalBudget) -> c_double;
+    pub fn expression_value_batch(
+        e: *mut CExpression,
+        vars: *const *mut c_double,
+        columns: *const *const c_double,
+        n_vars: size_t,
+        n_rows: size_t,
+        out: *mut c_double,
+    );
+    pub fn expression_value_batch_f32(
+        e: *mut CExpression,
+        vars: *const *mut c_double,
+        columns: *const *const c_float,
+        n_vars: size_t,
+        n_rows: size_t,
+        out: *mut c_float,
+    );
     pub fn expression_destroy(e: *mut CExpression);
 
     pub fn parser_new() -> *mut CParser;
+    pub fn parser_new_with_settings(s: *const CParserSettings) -> *mut CParser;
     pub fn parser_destroy(p: *mut CParser);
-    pub fn parser_compile(p: *mut CParser, s: *const c_char, e: *const CExpression) -> bool;
+    pub fn parser_compile(
+        p: *mut CParser,
+        s: *const c_char,
+        len: size_t,
+        e: *const CExpression,
+    ) -> bool;
     pub fn parser_compile_resolve(
         p: *mut CParser,
         s: *const c_char,
+        len: size_t,
         e: *const CExpression,
         cb: extern "C" fn(*const c_char, *mut c_void) -> *const c_char,
         fn_pointer: *mut c_void,
     ) -> bool;
-    pub fn parser_error(p: *mut CParser) -> *const CParseError;
-    pub fn parser_error_free(p: *const CParseError);
-
-    pub fn string_array_free(l: *mut CStrList);
+    pub fn parser_compile_auto_vars(
+        p: *mut CParser,
+        s: *const c_char,
+        len: size_t,
+        e: *const CExpression,
+        out: *mut CResolvedVars,
+    ) -> bool;
+    pub fn parser_error(p: *mut CParser, out: *mut CParseError) -> bool;
+    pub fn parser_token_count(p: *mut CParser) -> size_t;
 
     pub fn cpp_string_create(s: *const c_char, len: size_t) -> *mut CppString;
     pub fn cpp_string_set(s: *mut CppString, replacement: *const c_char, len: size_t);
-    pub fn cpp_string_get(s: *const CppString) -> *const c_char;
+    pub fn cpp_string_reserve(s: *mut CppString, capacity: size_t);
+    pub fn cpp_string_capacity(s: *const CppString) -> size_t;
+    pub fn cpp_string_data(s: *const CppString) -> CStrView;
     pub fn cpp_string_free(s: *mut CppString);
 
 }
@@ -0,0 +1,190 @@
+//! Evaluation of expressions over Arrow record batches (requires the `arrow` feature)
+
+use arrow::array::{ArrayRef, Float32Array, Float64Array};
+use arrow::buffer::{NullBuffer, ScalarBuffer};
+use arrow::compute::cast;
+use arrow::datatypes::{DataType, Schema};
+use arrow::error::ArrowError;
+use arrow::record_batch::RecordBatch;
+
+use super::*;
+
+/// Evaluates an expression over [Arrow](https://docs.rs/arrow) record batches,
+/// producing one `Float64Array` per batch.
+///
+/// The variables of the formula are bound to the columns of the given schema
+/// with the same name once, when compiling. The batches are then evaluated with
+/// `BlockEvaluator`, reading `Float64` columns directly from the Arrow buffers
+/// without copying. If all bound columns are `Float32`, they are read directly
+/// as well (with `BlockEvaluator::eval_batch_f32`); the computation is done in
+/// double precision, but the results are rounded to single precision like the
+/// input. Otherwise, columns of other numeric types are converted to `Float64`
+/// with the Arrow `cast` kernel first, which copies them for every batch.
+///
+/// A row of the result is null if it is null in any of the input columns. The
+/// validity bitmaps are combined with bitwise operations, without a branch per
+/// row. The formula is evaluated for null rows as well, with whatever value
+/// the column holds at that position.
+///
+/// # Example:
+/// ```
+/// use std::sync::Arc;
+/// use arrow::array::{Array, Float64Array};
+/// use arrow::datatypes::{DataType, Field, Schema};
+/// use arrow::record_batch::RecordBatch;
+/// use exprtk_rs::*;
+///
+/// let schema = Arc::new(Schema::new(vec![
+///     Field::new("x", DataType::Float64, true),
+///     Field::new("y", DataType::Float64, false),
+/// ]));
+/// let mut evaluator = ArrowEvaluator::new("x * y + 1", &schema).unwrap();
+///
+/// let batch = RecordBatch::try_new(schema, vec![
+///     Arc::new(Float64Array::from(vec![Some(1.), None, Some(3.)])),
+///     Arc::new(Float64Array::from(vec![2., 2., 2.])),
+/// ]).unwrap();
+/// let out = evaluator.evaluate(&batch).unwrap();
+/// assert_eq!(out.value(0), 3.);
+/// assert!(out.is_null(1));
+/// assert_eq!(out.value(2), 7.);
+/// ```
+pub struct ArrowEvaluator {
+    evaluator: BlockEvaluator,
+    // column names with the IDs of the variables bound to them
+    columns: Vec<(String, usize)>,
+}
+
+impl ArrowEvaluator {
+    /// Compiles the formula, binding every variable to the column of `schema`
+    /// with the same name. Returns `ParseError` if a name is neither a function
+    /// nor a column.
+    pub fn new(formula: &str, schema: &Schema) -> Result<ArrowEvaluator, ParseError> {
+        Self::with_symbols(formula, SymbolTable::new(), schema)
+    }
+
+    /// Compiles the formula like `ArrowEvaluator::new`, with an existing symbol
+    /// table, e.g. containing functions or constants. Only names not yet in the
+    /// symbol table are bound to columns.
+    pub fn with_symbols(
+        formula: &str,
+        symbols: SymbolTable,
+        schema: &Schema,
+    ) -> Result<ArrowEvaluator, ParseError> {
+        let mut columns = vec![];
+        let expr = Expression::handle_unknown(formula, symbols, |name, s| {
+            if schema.index_of(name).is_err() {
+                return Err(format!("Unknown column: '{}'", name));
+            }
+            let var_id = s
+                .add_variable(name, 0.)
+                .map_err(|e| e.to_string())?
+                .unwrap();
+            columns.push((name.to_string(), var_id));
+            Ok(())
+        })?;
+        Ok(ArrowEvaluator {
+            evaluator: BlockEvaluator::new(expr),
+            columns,
+        })
+    }
+
+    /// Returns the names of the columns used by the formula with the IDs of
+    /// the variables they are bound to
+    pub fn columns(&self) -> &[(String, usize)] {
+        &self.columns
+    }
+
+    /// Returns a reference to the expression
+    pub fn expression(&self) -> &Expression {
+        self.evaluator.expression()
+    }
+
+    /// Returns a mutable reference to the expression, e.g. for changing the
+    /// values of variables not bound to columns.
+    pub fn expression_mut(&mut self) -> &mut Expression {
+        self.evaluator.expression_mut()
+    }
+
+    /// Returns `true` if the formula is evaluated block-wise on the Rust side
+    /// (see `BlockEvaluator::is_vectorized`)
+    pub fn is_vectorized(&self) -> bool {
+        self.evaluator.is_vectorized()
+    }
+
+    /// Evaluates the expression for every row of the record batch. Returns an
+    /// error if a column is missing or cannot be converted to `Float64`.
+    pub fn evaluate(&mut self, batch: &RecordBatch) -> Result<Float64Array, ArrowError> {
+        let mut arrays: Vec<&ArrayRef> = Vec::with_capacity(self.columns.len());
+        for &(ref name, _) in &self.columns {
+            let array = batch
+                .column_by_name(name)
+                .ok_or_else(|| ArrowError::SchemaError(format!("Column '{}' not found", name)))?;
+            arrays.push(array);
+        }
+
+        let mut nulls = None;
+        for array in &arrays {
+            nulls = NullBuffer::union(nulls.as_ref(), array.nulls());
+        }
+
+        let all_f32 =
+            !arrays.is_empty() && arrays.iter().all(|a| a.data_type() == &DataType::Float32);
+        let out = if all_f32 {
+            self.evaluate_f32(&arrays, batch.num_rows())
+        } else {
+            self.evaluate_f64(&arrays, batch.num_rows())?
+        };
+        Ok(Float64Array::new(ScalarBuffer::from(out), nulls))
+    }
+
+    fn evaluate_f32(&mut self, arrays: &[&ArrayRef], n_rows: usize) -> Vec<c_double> {
+        let columns: Vec<(usize, &[f32])> = self
+            .columns
+            .iter()
+            .zip(arrays)
+            .map(|(&(_, var_id), array)| {
+                let values = array
+                    .as_any()
+                    .downcast_ref::<Float32Array>()
+                    .expect("Float32 column expected")
+                    .values();
+                (var_id, &values[..])
+            })
+            .collect();
+        let mut out = vec![0f32; n_rows];
+        self.evaluator.eval_batch_f32(&columns, &mut out);
+        out.into_iter().map(c_double::from).collect()
+    }
+
+    fn evaluate_f64(
+        &mut self,
+        arrays: &[&ArrayRef],
+        n_rows: usize,
+    ) -> Result<Vec<c_double>, ArrowError> {
+        let mut converted: Vec<ArrayRef> = Vec::with_capacity(arrays.len());
+        for &array in arrays {
+            converted.push(if array.data_type() == &DataType::Float64 {
+                array.clone()
+            } else {
+                cast(array.as_ref(), &DataType::Float64)?
+            });
+        }
+        let columns: Vec<(usize, &[c_double])> = self
+            .columns
+            .iter()
+            .zip(&converted)
+            .map(|(&(_, var_id), array)| {
+                let values = array
+                    .as_any()
+                    .downcast_ref::<Float64Array>()
+                    .expect("Float64 column expected")
+                    .values();
+                (var_id, &values[..])
+            })
+            .collect();
+        let mut out = vec![0.; n_rows];
+        self.evaluator.eval_batch(&columns, &mut out);
+        Ok(out)
+    }
+}
@@ -0,0 +1,391 @@
+//! Block-wise evaluation of simple formulas over columnar input
+
+use libc::c_double;
+
+use super::exprtk::{BatchValue, MAX_VEC_FUNC_ARGS};
+use super::ir::{self, BinaryOp, Node, UnaryOp};
+use super::*;
+
+/// Number of rows processed by every instruction of a `BlockEvaluator` at once
+const BLOCK_SIZE: usize = 512;
+
+/// Evaluates an expression over columnar input like `Expression::eval_batch`,
+/// but processes blocks of rows at once if the formula is simple enough.
+///
+/// Formulas consisting only of numbers, variables, constants, the operators
+/// `+ - * / % ^` and the functions `abs`, `sqrt`, `exp`, `log`, `log10`, `sin`,
+/// `cos`, `tan`, `floor`, `ceil`, `min` and `max` are translated into a
+/// sequence of instructions, each of which is applied to a whole block of rows
+/// in a tight loop, which the compiler can vectorize. This avoids walking the
+/// ExprTk node tree for every row. Functions added with `SymbolTable::add_vec_func`
+/// are supported as well, and are called once per block. All other formulas are transparently
+/// evaluated by ExprTk using `Expression::eval_batch` (see `is_vectorized`).
+///
+/// The results can differ from ExprTk in the last bits, since ExprTk uses
+/// its own implementations for some operations (e.g. `x^n` for integer `n`).
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+/// let y_id = symbol_table.add_variable("y", 0.).unwrap().unwrap();
+/// let expr = Expression::new("max(x, y) * 2 + 1", symbol_table).unwrap();
+/// let mut evaluator = BlockEvaluator::new(expr);
+/// assert!(evaluator.is_vectorized());
+///
+/// let x: Vec<f64> = (0..1000).map(|i| i as f64).collect();
+/// let y = vec![10.; 1000];
+/// let mut out = vec![0.; 1000];
+/// evaluator.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+/// assert_eq!(out[3], 21.);
+/// assert_eq!(out[20], 41.);
+/// ```
+pub struct BlockEvaluator {
+    expr: Expression,
+    program: Option<Program>,
+    // blocks of the value stack of the program
+    stack: Vec<c_double>,
+}
+
+impl BlockEvaluator {
+    pub fn new(expr: Expression) -> BlockEvaluator {
+        let program = ir::parse(expr.formula(), expr.symbols()).map(|n| Program::new(&n));
+        let stack_size = program.as_ref().map(|p| p.depth * BLOCK_SIZE).unwrap_or(0);
+        BlockEvaluator {
+            expr,
+            program,
+            stack: vec![0.; stack_size],
+        }
+    }
+
+    /// Returns `true` if the formula is evaluated block-wise, or `false` if
+    /// it is evaluated by ExprTk.
+    pub fn is_vectorized(&self) -> bool {
+        self.program.is_some()
+    }
+
+    /// Returns a reference to the expression
+    pub fn expression(&self) -> &Expression {
+        &self.expr
+    }
+
+    /// Returns a mutable reference to the expression, e.g. for changing the
+    /// values of variables without a column.
+    pub fn expression_mut(&mut self) -> &mut Expression {
+        &mut self.expr
+    }
+
+    /// Returns the expression
+    pub fn into_inner(self) -> Expression {
+        self.expr
+    }
+
+    /// Evaluates the expression for every row of columnar input, with the same
+    /// arguments and behavior as `Expression::eval_batch`.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    pub fn eval_batch(&mut self, columns: &[(usize, &[c_double])], out: &mut [c_double]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    /// Evaluates the expression for every row of single precision columnar
+    /// input with the same arguments and behavior as `Expression::eval_batch_f32`.
+    /// The values are converted to `f64` while loading a block, the computation
+    /// is done in double precision.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    pub fn eval_batch_f32(&mut self, columns: &[(usize, &[f32])], out: &mut [f32]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    fn eval_batch_generic<T: BatchValue>(&mut self, columns: &[(usize, &[T])], out: &mut [T]) {
+        let program = match self.program {
+            Some(ref p) => p,
+            None => return self.expr.eval_batch_generic(columns, out),
+        };
+        let symbols = self.expr.symbols();
+        for &(var_id, column) in columns {
+            assert_eq!(
+                column.len(),
+                out.len(),
+                "Column length does not match the output length"
+            );
+            symbols.value(var_id);
+        }
+        let inputs: Vec<Input<T>> = program
+            .vars
+            .iter()
+            .map(
+                |&var_id| match columns.iter().rev().find(|c| c.0 == var_id) {
+                    Some(&(_, column)) => Input::Column(column),
+                    None => Input::Scalar(symbols.value(var_id)),
+                },
+            )
+            .collect();
+
+        for (i, out_block) in out.chunks_mut(BLOCK_SIZE).enumerate() {
+            program.run(symbols, &inputs, i * BLOCK_SIZE, &mut self.stack, out_block);
+        }
+
+        // the variables keep the values of the last row
+        if !out.is_empty() {
+            for &(var_id, column) in columns {
+                *self.expr.symbols_mut().value_mut(var_id) = column[column.len() - 1].to_f64();
+            }
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+enum Input<'a, T> {
+    Column(&'a [T]),
+    Scalar(c_double),
+}
+
+#[derive(Clone, Copy, Debug)]
+enum Instr {
+    /// Pushes a block filled with a constant
+    Const(c_double),
+    /// Pushes a block with values of the variable at the given index of `Program::vars`
+    Load(usize),
+    /// Applies an operation to the topmost block
+    Unary(UnaryOp),
+    /// Combines the two topmost blocks
+    Binary(BinaryOp),
+    /// Combines the topmost block with a constant (as right operand)
+    ConstRhs(BinaryOp, c_double),
+    /// Combines a constant (as left operand) with the topmost block
+    ConstLhs(c_double, BinaryOp),
+    /// Calls a function added with `add_vec_func` (index, number of arguments)
+    /// with the topmost blocks as arguments
+    Call(usize, usize),
+}
+
+/// Formula in postfix order, operating on a stack of blocks
+struct Program {
+    instrs: Vec<Instr>,
+    // IDs of the variables used
+    vars: Vec<usize>,
+    // maximum number of blocks on the stack
+    depth: usize,
+}
+
+impl Program {
+    fn new(node: &Node) -> Program {
+        let mut p = Program {
+            instrs: vec![],
+            vars: vec![],
+            depth: 0,
+        };
+        p.emit(node, 0);
+        p
+    }
+
+    // Appends the instructions for a node, the stack holds `depth` blocks before.
+    fn emit(&mut self, node: &Node, depth: usize) {
+        self.depth = self.depth.max(depth + 1);
+        match *node {
+            Node::Const(c) => self.instrs.push(Instr::Const(c)),
+            Node::Var(var_id) => {
+                let i = match self.vars.iter().position(|&v| v == var_id) {
+                    Some(i) => i,
+                    None => {
+                        self.vars.push(var_id);
+                        self.vars.len() - 1
+                    }
+                };
+                self.instrs.push(Instr::Load(i));
+            }
+            Node::Unary(op, ref a) => {
+                self.emit(a, depth);
+                self.instrs.push(Instr::Unary(op));
+            }
+            Node::Binary(op, ref a, ref b) => match (&**a, &**b) {
+                (a, &Node::Const(c)) => {
+                    self.emit(a, depth);
+                    self.instrs.push(Instr::ConstRhs(op, c));
+                }
+                (&Node::Const(c), b) => {
+                    self.emit(b, depth);
+                    self.instrs.push(Instr::ConstLhs(c, op));
+                }
+                (a, b) => {
+                    self.emit(a, depth);
+                    self.emit(b, depth + 1);
+                    self.instrs.push(Instr::Binary(op));
+                }
+            },
+            Node::Call(func, ref args) => {
+                for (i, a) in args.iter().enumerate() {
+                    self.emit(a, depth + i);
+                }
+                // one more block for the output
+                self.depth = self.depth.max(depth + args.len() + 1);
+                self.instrs.push(Instr::Call(func, args.len()));
+            }
+        }
+    }
+
+    /// Evaluates the rows `start..start + out.len()` (at most BLOCK_SIZE)
+    fn run<T: BatchValue>(
+        &self,
+        symbols: &SymbolTable,
+        inputs: &[Input<T>],
+        start: usize,
+        stack: &mut [c_double],
+        out: &mut [T],
+    ) {
+        let len = out.len();
+        let mut sp = 0;
+        for instr in &self.instrs {
+            match *instr {
+                Instr::Const(c) => {
+                    fill(block(stack, sp, len), c);
+                    sp += 1;
+                }
+                Instr::Load(i) => {
+                    let b = block(stack, sp, len);
+                    match inputs[i] {
+                        Input::Column(col) => load(b, &col[start..start + len]),
+                        Input::Scalar(v) => fill(b, v),
+                    }
+                    sp += 1;
+                }
+                Instr::Unary(op) => unary(op, block(stack, sp - 1, len)),
+                Instr::Binary(op) => {
+                    let (lower, upper) = stack.split_at_mut((sp - 1) * BLOCK_SIZE);
+                    let a = &mut lower[(sp - 2) * BLOCK_SIZE..][..len];
+                    binary(op, a, &upper[..len]);
+                    sp -= 1;
+                }
+                Instr::ConstRhs(op, c) => const_rhs(op, block(stack, sp - 1, len), c),
+                Instr::ConstLhs(c, op) => const_lhs(op, c, block(stack, sp - 1, len)),
+                Instr::Call(func, n_args) => {
+                    sp -= n_args;
+                    let (lower, upper) = stack.split_at_mut((sp + n_args) * BLOCK_SIZE);
+                    let mut args: [&[c_double]; MAX_VEC_FUNC_ARGS] = [&[]; MAX_VEC_FUNC_ARGS];
+                    for (i, a) in args[..n_args].iter_mut().enumerate() {
+                        *a = &lower[(sp + i) * BLOCK_SIZE..][..len];
+                    }
+                    symbols.call_vec_func(func, &args[..n_args], &mut upper[..len]);
+                    // move the result to the position of the first argument
+                    let result = (sp + n_args) * BLOCK_SIZE;
+                    stack.copy_within(result..result + len, sp * BLOCK_SIZE);
+                    sp += 1;
+                }
+            }
+        }
+        debug_assert_eq!(sp, 1);
+        for (o, &v) in out.iter_mut().zip(&stack[..len]) {
+            *o = T::from_f64(v);
+        }
+    }
+}
+
+#[inline]
+fn block(stack: &mut [c_double], i: usize, len: usize) -> &mut [c_double] {
+    &mut stack[i * BLOCK_SIZE..][..len]
+}
+
+#[inline]
+fn load<T: BatchValue>(x: &mut [c_double], column: &[T]) {
+    for (v, &c) in x.iter_mut().zip(column) {
+        *v = c.to_f64();
+    }
+}
+
+#[inline]
+fn fill(x: &mut [c_double], value: c_double) {
+    for v in x {
+        *v = value;
+    }
+}
+
+// The operation is matched once per block and the loop is generated for
+// every operation separately, so it only contains a single operation and
+// can be vectorized.
+
+macro_rules! with_unary_op {
+    ($op:expr, $f:ident($($arg:expr),*)) => {
+        match $op {
+            UnaryOp::Neg => $f($($arg,)* |x| UnaryOp::Neg.apply(x)),
+            UnaryOp::Abs => $f($($arg,)* |x| UnaryOp::Abs.apply(x)),
+            UnaryOp::Sqrt => $f($($arg,)* |x| UnaryOp::Sqrt.apply(x)),
+            UnaryOp::Exp => $f($($arg,)* |x| UnaryOp::Exp.apply(x)),
+            UnaryOp::Log => $f($($arg,)* |x| UnaryOp::Log.apply(x)),
+            UnaryOp::Log10 => $f($($arg,)* |x| UnaryOp::Log10.apply(x)),
+            UnaryOp::Sin => $f($($arg,)* |x| UnaryOp::Sin.apply(x)),
+            UnaryOp::Cos => $f($($arg,)* |x| UnaryOp::Cos.apply(x)),
+            UnaryOp::Tan => $f($($arg,)* |x| UnaryOp::Tan.apply(x)),
+            UnaryOp::Floor => $f($($arg,)* |x| UnaryOp::Floor.apply(x)),
+            UnaryOp::Ceil => $f($($arg,)* |x| UnaryOp::Ceil.apply(x)),
+        }
+    };
+}
+
+macro_rules! with_binary_op {
+    ($op:expr, $f:ident($($arg:expr),*)) => {
+        match $op {
+            BinaryOp::Add => $f($($arg,)* |a, b| BinaryOp::Add.apply(a, b)),
+            BinaryOp::Sub => $f($($arg,)* |a, b| BinaryOp::Sub.apply(a, b)),
+            BinaryOp::Mul => $f($($arg,)* |a, b| BinaryOp::Mul.apply(a, b)),
+            BinaryOp::Div => $f($($arg,)* |a, b| BinaryOp::Div.apply(a, b)),
+            BinaryOp::Rem => $f($($arg,)* |a, b| BinaryOp::Rem.apply(a, b)),
+            BinaryOp::Pow => $f($($arg,)* |a, b| BinaryOp::Pow.apply(a, b)),
+            BinaryOp::Min => $f($($arg,)* |a, b| BinaryOp::Min.apply(a, b)),
+            BinaryOp::Max => $f($($arg,)* |a, b| BinaryOp::Max.apply(a, b)),
+        }
+    };
+}
+
+fn unary(op: UnaryOp, x: &mut [c_double]) {
+    with_unary_op!(op, map_block(x))
+}
+
+fn binary(op: BinaryOp, a: &mut [c_double], b: &[c_double]) {
+    with_binary_op!(op, zip_blocks(a, b))
+}
+
+fn const_rhs(op: BinaryOp, a: &mut [c_double], c: c_double) {
+    with_binary_op!(op, map_const_rhs(a, c))
+}
+
+fn const_lhs(op: BinaryOp, c: c_double, b: &mut [c_double]) {
+    with_binary_op!(op, map_const_lhs(c, b))
+}
+
+#[inline(always)]
+fn map_block<F: Fn(c_double) -> c_double>(x: &mut [c_double], f: F) {
+    for v in x {
+        *v = f(*v);
+    }
+}
+
+#[inline(always)]
+fn zip_blocks<F: Fn(c_double, c_double) -> c_double>(a: &mut [c_double], b: &[c_double], f: F) {
+    for (x, &y) in a.iter_mut().zip(b) {
+        *x = f(*x, y);
+    }
+}
+
+#[inline(always)]
+fn map_const_rhs<F: Fn(c_double, c_double) -> c_double>(a: &mut [c_double], c: c_double, f: F) {
+    for x in a {
+        *x = f(*x, c);
+    }
+}
+
+#[inline(always)]
+fn map_const_lhs<F: Fn(c_double, c_double) -> c_double>(c: c_double, b: &mut [c_double], f: F) {
+    for y in b {
+        *y = f(c, *y);
+    }
+}
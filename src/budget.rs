@@ -0,0 +1,225 @@
+//! Limits for evaluating untrusted formulas, and cooperative batch evaluation
+
+use std::future::Future;
+use std::pin::Pin;
+use std::ptr;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::task::{Context, Poll};
+use std::time::{Duration, Instant};
+
+use libc::c_double;
+
+use exprtk_sys::*;
+
+use super::*;
+
+pub(crate) fn duration_ns(d: Duration) -> u64 {
+    d.as_secs()
+        .saturating_mul(1_000_000_000)
+        .saturating_add(u64::from(d.subsec_nanos()))
+}
+
+/// Flag for cancelling evaluations from another thread. Clones refer to the
+/// same flag.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let token = CancelToken::new();
+/// let budget = EvalBudget::new().cancel_token(&token);
+/// let mut expr = Expression::new("1 + 1", SymbolTable::new()).unwrap();
+/// assert_eq!(expr.value_with_budget(&budget), Ok(2.));
+///
+/// token.clone().cancel();
+/// assert_eq!(expr.value_with_budget(&budget), Err(EvalError::Cancelled));
+/// ```
+#[derive(Clone, Debug, Default)]
+pub struct CancelToken(Arc<AtomicBool>);
+
+impl CancelToken {
+    pub fn new() -> CancelToken {
+        Self::default()
+    }
+
+    /// Cancels all evaluations using this token, which stop with
+    /// `EvalError::Cancelled` at the next loop iteration
+    pub fn cancel(&self) {
+        self.0.store(true, Ordering::Relaxed);
+    }
+
+    pub fn is_cancelled(&self) -> bool {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// Limits for evaluating formulas that may not terminate, e.g. formulas
+/// submitted by users containing `while` loops (see
+/// `Expression::value_with_budget`). By default, there are no limits.
+#[derive(Clone, Debug)]
+pub struct EvalBudget {
+    max_iterations: u64,
+    deadline: Option<Instant>,
+    cancel: Option<CancelToken>,
+    time_slice: Duration,
+}
+
+impl EvalBudget {
+    pub fn new() -> EvalBudget {
+        EvalBudget {
+            max_iterations: 0,
+            deadline: None,
+            cancel: None,
+            time_slice: Duration::from_millis(1),
+        }
+    }
+
+    /// Sets the maximum total number of loop iterations per evaluation. Zero
+    /// means no limit.
+    pub fn max_iterations(mut self, n: u64) -> Self {
+        self.max_iterations = n;
+        self
+    }
+
+    /// Stops evaluating with `EvalError::Timeout` after the given point in time
+    pub fn deadline(mut self, deadline: Instant) -> Self {
+        self.deadline = Some(deadline);
+        self
+    }
+
+    /// Sets the deadline to `timeout` from now. The deadline is not moved
+    /// if the budget is used for several evaluations.
+    pub fn timeout(self, timeout: Duration) -> Self {
+        self.deadline(Instant::now() + timeout)
+    }
+
+    /// Stops evaluating with `EvalError::Cancelled` once the token is cancelled
+    pub fn cancel_token(mut self, token: &CancelToken) -> Self {
+        self.cancel = Some(token.clone());
+        self
+    }
+
+    /// Sets the time after which `Expression::eval_batch_async` yields to the
+    /// executor (1 ms by default). It is checked between the rows.
+    pub fn time_slice(mut self, slice: Duration) -> Self {
+        self.time_slice = slice;
+        self
+    }
+
+    /// Returns the limits for the C++ side, or an error if the budget is
+    /// already exhausted
+    pub(crate) fn to_c(&self) -> Result<CEvalBudget, EvalError> {
+        let cancel = match self.cancel {
+            Some(ref token) if token.is_cancelled() => return Err(EvalError::Cancelled),
+            Some(ref token) => &*token.0 as *const AtomicBool,
+            None => ptr::null(),
+        };
+        let timeout_ns = match self.deadline {
+            Some(deadline) => {
+                let now = Instant::now();
+                if deadline <= now {
+                    return Err(EvalError::Timeout);
+                }
+                duration_ns(deadline - now).max(1)
+            }
+            None => 0,
+        };
+        Ok(CEvalBudget {
+            max_iterations: self.max_iterations,
+            iterations: 0,
+            timeout_ns,
+            cancel,
+            status: BUDGET_OK,
+        })
+    }
+}
+
+impl Default for EvalBudget {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Expression {
+    /// Returns a future evaluating the expression for every row of columnar
+    /// input like `Expression::eval_batch`, which yields to the executor
+    /// whenever the time slice of the budget (see `EvalBudget::time_slice`)
+    /// is used up.
+    ///
+    /// Each row is evaluated with `value_with_budget`, so the iteration limit
+    /// applies to every row, and the deadline and cancellation to the whole
+    /// batch. The future completes with the first error; the rows before
+    /// it are written to `out`. A single row cannot be interrupted, so an
+    /// iteration limit keeps slow rows from blocking the executor for long.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    pub fn eval_batch_async<'a>(
+        &'a mut self,
+        columns: &'a [(usize, &'a [c_double])],
+        out: &'a mut [c_double],
+        budget: EvalBudget,
+    ) -> EvalBatch<'a> {
+        for &(var_id, column) in columns {
+            assert_eq!(
+                column.len(),
+                out.len(),
+                "Column length does not match the output length"
+            );
+            self.symbols().value(var_id);
+        }
+        EvalBatch {
+            expr: self,
+            columns,
+            out,
+            budget,
+            row: 0,
+        }
+    }
+}
+
+/// Future returned by `Expression::eval_batch_async`
+#[derive(Debug)]
+pub struct EvalBatch<'a> {
+    expr: &'a mut Expression,
+    columns: &'a [(usize, &'a [c_double])],
+    out: &'a mut [c_double],
+    budget: EvalBudget,
+    // next row to evaluate
+    row: usize,
+}
+
+impl<'a> EvalBatch<'a> {
+    /// Returns the number of rows evaluated so far
+    pub fn rows_done(&self) -> usize {
+        self.row
+    }
+}
+
+impl<'a> Future for EvalBatch<'a> {
+    type Output = Result<(), EvalError>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        let this = self.get_mut();
+        let slice_end = Instant::now() + this.budget.time_slice;
+        while this.row < this.out.len() {
+            let row = this.row;
+            for &(var_id, column) in this.columns {
+                *this.expr.symbols_mut().value_mut(var_id) = column[row];
+            }
+            match this.expr.value_with_budget(&this.budget) {
+                Ok(v) => this.out[row] = v,
+                Err(e) => return Poll::Ready(Err(e)),
+            }
+            this.row += 1;
+            if this.row < this.out.len() && Instant::now() >= slice_end {
+                cx.waker().wake_by_ref();
+                return Poll::Pending;
+            }
+        }
+        Poll::Ready(Ok(()))
+    }
+}
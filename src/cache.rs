@@ -0,0 +1,189 @@
+//! Cache of compiled expressions, which avoids recompiling the same formulae.
+
+use std::collections::{BTreeMap, HashMap};
+
+use super::*;
+
+/// Hit / miss statistics of an `ExpressionCache`
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct CacheStats {
+    /// Number of `get()` calls served with a cached expression
+    pub hits: u64,
+    /// Number of `get()` calls that required compiling the formula
+    pub misses: u64,
+    /// Number of expressions removed because the capacity or memory limit was reached
+    pub evictions: u64,
+}
+
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+struct CacheKey {
+    formula: String,
+    signature: String,
+}
+
+/// Keeps compiled expressions for reuse, keyed by their formula and the layout
+/// of their symbol table (names of variables, strings, vectors and functions
+/// in the order of their IDs).
+///
+/// Since an ExprTk expression cannot be copied without recompiling it, the
+/// cache does not hand out clones. Instead, `get()` removes a matching expression
+/// from the cache (or compiles a new one if there is none), and `put()` returns
+/// it to the cache once it is not needed anymore. With many requests for the same
+/// formulae, most will thus be served without compiling.
+///
+/// The cache holds at most `capacity` expressions. Optionally, their total memory
+/// usage can be limited as well (see `with_memory_limit`). The least recently
+/// returned expressions are removed first.
+///
+/// **Note**: Functions are only compared by their name, an expression from the
+/// cache will always call the function that was registered when compiling it.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut cache = ExpressionCache::new(100);
+/// let mut symbols = SymbolTable::new();
+/// let x_id = symbols.add_variable("x", 0.).unwrap().unwrap();
+///
+/// for x in 0..10 {
+///     *symbols.value_mut(x_id) = x as f64;
+///     let mut expr = cache.get("x^2 + 1", &symbols).unwrap();
+///     assert_eq!(expr.value(), (x * x + 1) as f64);
+///     cache.put(expr);
+/// }
+/// assert_eq!(cache.stats().misses, 1);
+/// assert_eq!(cache.stats().hits, 9);
+/// ```
+pub struct ExpressionCache {
+    capacity: usize,
+    max_bytes: usize,
+    // idle expressions with the time of their insertion (most recent last)
+    entries: HashMap<CacheKey, Vec<(u64, usize, Expression)>>,
+    // insertion time -> key, for finding the least recently used entry
+    order: BTreeMap<u64, CacheKey>,
+    time: u64,
+    len: usize,
+    bytes: usize,
+    stats: CacheStats,
+}
+
+impl ExpressionCache {
+    /// Creates a cache holding at most `capacity` expressions.
+    pub fn new(capacity: usize) -> ExpressionCache {
+        ExpressionCache {
+            capacity,
+            max_bytes: usize::max_value(),
+            entries: HashMap::new(),
+            order: BTreeMap::new(),
+            time: 0,
+            len: 0,
+            bytes: 0,
+            stats: CacheStats::default(),
+        }
+    }
+
+    /// Creates a cache holding at most `capacity` expressions, which together
+    /// use at most `max_bytes` bytes (as estimated by
+    /// `Expression::estimated_memory_usage`).
+    pub fn with_memory_limit(capacity: usize, max_bytes: usize) -> ExpressionCache {
+        let mut c = Self::new(capacity);
+        c.max_bytes = max_bytes;
+        c
+    }
+
+    /// Returns a ready-to-evaluate expression for the formula. If the cache
+    /// contains an expression with the same formula and symbol table layout, it is
+    /// removed from the cache, and the values of its variables, strings and vectors
+    /// are set to those in `symbols`. Otherwise, the formula is compiled with a copy
+    /// of `symbols`.
+    pub fn get(&mut self, formula: &str, symbols: &SymbolTable) -> Result<Expression, ParseError> {
+        let key = CacheKey {
+            formula: formula.to_string(),
+            signature: symbols.signature(),
+        };
+        let cached = self.entries.get_mut(&key).and_then(|e| e.pop());
+        if let Some((time, bytes, mut expr)) = cached {
+            if self.entries[&key].is_empty() {
+                self.entries.remove(&key);
+            }
+            self.order.remove(&time);
+            self.len -= 1;
+            self.bytes -= bytes;
+            self.stats.hits += 1;
+            expr.symbols_mut().copy_values_from(symbols);
+            return Ok(expr);
+        }
+        self.stats.misses += 1;
+        Expression::new(formula, symbols.clone())
+    }
+
+    /// Returns an expression to the cache, making it available to `get()`.
+    /// Afterwards, the least recently used expressions are removed until the
+    /// cache is within its limits.
+    pub fn put(&mut self, expr: Expression) {
+        let bytes = expr.estimated_memory_usage();
+        if self.capacity == 0 || bytes > self.max_bytes {
+            self.stats.evictions += 1;
+            return;
+        }
+        let key = CacheKey {
+            formula: expr.formula().to_string(),
+            signature: expr.symbols().signature(),
+        };
+        self.time += 1;
+        self.order.insert(self.time, key.clone());
+        self.entries
+            .entry(key)
+            .or_insert_with(Vec::new)
+            .push((self.time, bytes, expr));
+        self.len += 1;
+        self.bytes += bytes;
+
+        while self.len > self.capacity || self.bytes > self.max_bytes {
+            self.evict_oldest();
+        }
+    }
+
+    fn evict_oldest(&mut self) {
+        let time = *self.order.keys().next().unwrap();
+        let key = self.order.remove(&time).unwrap();
+        let exprs = self.entries.get_mut(&key).unwrap();
+        // the oldest entry for a key is always the first one
+        let (_, bytes, _) = exprs.remove(0);
+        if exprs.is_empty() {
+            self.entries.remove(&key);
+        }
+        self.len -= 1;
+        self.bytes -= bytes;
+        self.stats.evictions += 1;
+    }
+
+    /// Returns the hit / miss statistics
+    pub fn stats(&self) -> CacheStats {
+        self.stats
+    }
+
+    /// Returns the number of cached expressions
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Returns the total memory usage of the cached expressions, as counted for
+    /// the limit of `with_memory_limit`
+    pub fn memory_usage(&self) -> usize {
+        self.bytes
+    }
+
+    /// Removes all expressions from the cache. The statistics are not reset.
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.order.clear();
+        self.len = 0;
+        self.bytes = 0;
+    }
+}
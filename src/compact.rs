@@ -0,0 +1,146 @@
+//! Expressions sharing one symbol table, for keeping many of them in memory
+
+use std::fmt;
+use std::mem;
+use std::rc::Rc;
+
+use libc::c_double;
+
+use exprtk_sys::*;
+
+use super::exprtk::{EXPRESSION_BYTES, NODE_BYTES_PER_CHAR};
+use super::*;
+
+/// Compiled expression using a symbol table shared with other expressions,
+/// for keeping large numbers of expressions in memory.
+///
+/// An `Expression` owns a symbol table (with a C++ `symbol_table` and its hash
+/// maps) and the formula string, which together take at least a few kilobytes.
+/// A `CompactExpression` only consists of the ExprTk node tree, a reference
+/// to the shared `SymbolTable` and optionally the formula (see `with_formula`).
+/// `estimated_memory_usage` estimates the bytes used per expression.
+///
+/// The symbol table is shared with `Rc`, so it cannot be modified anymore, but
+/// the values of variables can still be changed with `SymbolTable::value_cell`.
+/// A `CompactExpression` cannot be sent to another thread: evaluating formulas
+/// that assign to the shared variables, or changing them with `value_cell`,
+/// is only free of data races in a single thread (the reference count of the
+/// C++ symbol table is not atomic either). For multithreaded use, every thread
+/// needs its own symbol table.
+///
+/// # Example:
+/// ```
+/// use std::rc::Rc;
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+/// let symbols = Rc::new(symbol_table);
+///
+/// let mut rules: Vec<_> = (0..1000)
+///     .map(|i| CompactExpression::new(&format!("x > {}", i), &symbols).unwrap())
+///     .collect();
+///
+/// symbols.value_cell(x_id).set(500.5);
+/// assert_eq!(rules.iter_mut().filter(|r| r.value() == 1.).count(), 501);
+/// assert!(rules[0].formula().is_none());
+/// ```
+pub struct CompactExpression {
+    expr: *mut CExpression,
+    symbols: Rc<SymbolTable>,
+    formula: Option<Box<str>>,
+    // length of the compiled formula, for estimating the size of the node
+    // tree (also if the formula is not retained)
+    formula_len: usize,
+}
+
+impl CompactExpression {
+    /// Compiles a formula using the shared symbol table. The formula is not
+    /// retained.
+    pub fn new(formula: &str, symbols: &Rc<SymbolTable>) -> Result<CompactExpression, ParseError> {
+        Parser::with_pooled(|parser| Self::with_parser(formula, symbols, parser))
+    }
+
+    /// Compiles like `CompactExpression::new`, but keeps a copy of the formula,
+    /// which is returned by `formula()`.
+    pub fn with_formula(
+        formula: &str,
+        symbols: &Rc<SymbolTable>,
+    ) -> Result<CompactExpression, ParseError> {
+        let mut e = Self::new(formula, symbols)?;
+        e.formula = Some(formula.into());
+        Ok(e)
+    }
+
+    /// Compiles like `CompactExpression::new`, but using the supplied `Parser`
+    /// instead of one from the thread-local pool.
+    pub fn with_parser(
+        formula: &str,
+        symbols: &Rc<SymbolTable>,
+        parser: &Parser,
+    ) -> Result<CompactExpression, ParseError> {
+        let e = CompactExpression {
+            expr: unsafe { expression_new() },
+            symbols: symbols.clone(),
+            formula: None,
+            formula_len: formula.len(),
+        };
+        unsafe { expression_register_symbol_table(e.expr, e.symbols.sym) };
+        parser.compile_raw(formula, e.expr)?;
+        Ok(e)
+    }
+
+    /// Calculates the value of the expression
+    pub fn value(&mut self) -> c_double {
+        unsafe { expression_value(self.expr) }
+    }
+
+    /// Calculates the value within the limits of `budget` (see
+    /// `Expression::value_with_budget`)
+    pub fn value_with_budget(&mut self, budget: &EvalBudget) -> Result<c_double, EvalError> {
+        let mut b = budget.to_c()?;
+        let v = unsafe { expression_value_budget(self.expr, &mut b) };
+        match EvalError::from_status(b.status) {
+            Some(e) => Err(e),
+            None => Ok(v),
+        }
+    }
+
+    /// Returns the shared symbol table
+    pub fn symbols(&self) -> &Rc<SymbolTable> {
+        &self.symbols
+    }
+
+    /// Returns the formula if constructed with `with_formula`
+    pub fn formula(&self) -> Option<&str> {
+        self.formula.as_ref().map(|f| &**f)
+    }
+
+    /// Returns a rough estimate of the number of bytes of memory used by the
+    /// expression, without the shared symbol table. Like
+    /// `Expression::estimated_memory_usage`, this is a heuristic: the size of
+    /// the ExprTk node tree is guessed from the length of the compiled formula
+    /// (whether or not it is retained).
+    pub fn estimated_memory_usage(&self) -> usize {
+        mem::size_of::<CompactExpression>()
+            + self.formula.as_ref().map_or(0, |f| f.len())
+            + EXPRESSION_BYTES
+            + self.formula_len * NODE_BYTES_PER_CHAR
+    }
+}
+
+impl Drop for CompactExpression {
+    fn drop(&mut self) {
+        unsafe { expression_destroy(self.expr) };
+    }
+}
+
+impl fmt::Debug for CompactExpression {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(
+            f,
+            "CompactExpression {{ formula: {:?}, symbols: {:?} }}",
+            self.formula, self.symbols
+        )
+    }
+}
@@ -1,9 +1,9 @@
 use std::error::Error;
-use std::ffi::CStr;
 use std::fmt;
 
 use enum_primitive::FromPrimitive;
 use exprtk_sys::*;
+use libc::c_int;
 
 pub type ParseResult<T> = Result<T, ParseError>;
 
@@ -33,20 +33,19 @@ impl ParseError {
     }
 
     pub(super) unsafe fn from_c_err(c_parser: *mut CParser) -> Option<Self> {
-        let e: &CParseError = &*parser_error(c_parser);
-        if e.is_err {
-            let err_out = ParseError {
-                kind: ParseErrorKind::from_i32(e.mode as i32)
-                    .unwrap_or_else(|| panic!("Unknown ParseErrorKind enum variant: {}", e.mode)),
-                token_type: string_from_ptr!(e.token_type),
-                token_value: string_from_ptr!(e.token_value),
-                message: string_from_ptr!(e.diagnostic),
-                line: string_from_ptr!(e.error_line),
+        // the string views point into the parser and are copied right away
+        let mut e = CParseError::empty();
+        if parser_error(c_parser, &mut e) {
+            Some(ParseError {
+                // e.g. errors of the compilation timeout check
+                kind: ParseErrorKind::from_i32(e.mode as i32).unwrap_or(ParseErrorKind::Unknown),
+                token_type: string_from_view!(e.token_type),
+                token_value: string_from_view!(e.token_value),
+                message: string_from_view!(e.diagnostic),
+                line: string_from_view!(e.error_line),
                 line_no: e.line_no as usize,
                 column_no: e.column_no as usize,
-            };
-            parser_error_free(e as *const CParseError);
-            Some(err_out)
+            })
         } else {
             None
         }
@@ -98,3 +97,72 @@ impl From<InvalidName> for ParseError {
         ParseError::simple_syntax(&e.0, "Non-ASCII character or null byte found in formula")
     }
 }
+
+/// Error returned by `Expression::deserialize`
+#[derive(Debug, PartialEq, Clone)]
+pub enum LoadError {
+    /// The data are truncated or not in the expected format
+    InvalidFormat,
+    /// The data were written with a different version of the crate, ExprTk
+    /// revision or set of features
+    VersionMismatch,
+    /// The symbol table does not have the same layout as the serialized one
+    LayoutMismatch,
+    /// Compiling the formula failed
+    Parse(ParseError),
+}
+
+impl fmt::Display for LoadError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match *self {
+            LoadError::InvalidFormat => write!(f, "Invalid serialized expression"),
+            LoadError::VersionMismatch => {
+                write!(f, "Serialized expression from incompatible build")
+            }
+            LoadError::LayoutMismatch => write!(f, "Symbol table layout does not match"),
+            LoadError::Parse(ref e) => e.fmt(f),
+        }
+    }
+}
+
+impl Error for LoadError {}
+
+impl From<ParseError> for LoadError {
+    fn from(e: ParseError) -> Self {
+        LoadError::Parse(e)
+    }
+}
+
+/// Error returned if an evaluation exceeds its `EvalBudget`
+#[derive(Debug, PartialEq, Eq, Clone, Copy)]
+pub enum EvalError {
+    /// More loop iterations than allowed
+    IterationLimit,
+    /// The deadline has passed
+    Timeout,
+    /// The `CancelToken` was triggered
+    Cancelled,
+}
+
+impl EvalError {
+    pub(super) fn from_status(status: c_int) -> Option<EvalError> {
+        match status {
+            BUDGET_ITERATIONS => Some(EvalError::IterationLimit),
+            BUDGET_TIMEOUT => Some(EvalError::Timeout),
+            BUDGET_CANCELLED => Some(EvalError::Cancelled),
+            _ => None,
+        }
+    }
+}
+
+impl fmt::Display for EvalError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match *self {
+            EvalError::IterationLimit => write!(f, "Loop iteration limit exceeded"),
+            EvalError::Timeout => write!(f, "Evaluation timed out"),
+            EvalError::Cancelled => write!(f, "Evaluation cancelled"),
+        }
+    }
+}
+
+impl Error for EvalError {}
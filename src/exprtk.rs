@@ -1,10 +1,20 @@
-use std::cell::Cell;
+use std::any::TypeId;
+use std::borrow::Cow;
+use std::cell::{Cell, RefCell};
+use std::collections::HashMap;
 use std::ffi::*;
 use std::fmt;
+use std::marker::PhantomData;
 use std::mem;
 use std::ops::Drop;
 use std::ptr;
+use std::slice;
+use std::str;
+use std::time::Duration;
+#[cfg(feature = "stats")]
+use std::time::Instant;
 
+use super::budget::duration_ns;
 use super::*;
 use exprtk_sys::*;
 use libc::{c_char, c_double, c_void, size_t};
@@ -18,34 +28,303 @@ unsafe impl Send for SymbolTable {}
 unsafe impl Sync for SymbolTable {}
 unsafe impl Send for StringValue {}
 unsafe impl Sync for StringValue {}
+// A parser can be moved to another thread, but compiling mutates its
+// internal state, so it must not be shared between threads.
+unsafe impl Send for Parser {}
+
+/// Checks a name and returns it as (pointer, length) for passing to C++.
+/// The only check done here are null bytes, other invalid names are
+/// detected by ExprTk.
+#[inline]
+fn c_name(s: &str) -> Result<(*const c_char, size_t), InvalidName> {
+    if s.as_bytes().contains(&0) {
+        return Err(InvalidName(s.to_string()));
+    }
+    Ok((s.as_ptr() as *const c_char, s.len()))
+}
+
+/// Returns the key used for looking up the ID of a symbol by name.
+/// Names are case-insensitive if ExprTk was built with case insensitivity
+/// (`exprtk_sys::CASE_INSENSITIVE`, valid names are ASCII-only).
+#[inline]
+pub(crate) fn name_key<'a>(name: &'a str) -> Cow<'a, str> {
+    if CASE_INSENSITIVE && name.bytes().any(|b| b.is_ascii_uppercase()) {
+        Cow::Owned(name.to_ascii_lowercase())
+    } else {
+        Cow::Borrowed(name)
+    }
+}
 
-fn c_string(s: &str) -> Result<CString, InvalidName> {
-    CString::new(s).map_err(|_| InvalidName(s.to_string()))
+/// Callback collecting the names listed by the `symbol_table_get_*_list`
+/// functions into a `Vec<String>` (passed as `user_data`)
+extern "C" fn push_name(user_data: *mut c_void, name: *const c_char, len: size_t) {
+    let names = unsafe { &mut *(user_data as *mut Vec<String>) };
+    let view = CStrView { data: name, len };
+    names.push(unsafe { string_from_view!(view) });
+}
+
+/// Settings for constructing a `Parser`, which allow trading compile time
+/// against evaluation speed, or restricting the accepted formulas.
+/// `ParserSettings::new()` corresponds to the ExprTk defaults, which are also
+/// used by `Parser::new()`. Note that some of the compile options also change
+/// the accepted syntax.
+///
+/// Constant folding is always done by ExprTk (see also `FunctionOptions`),
+/// and loop unrolling can only be disabled at build time
+/// (`superscalar_unroll` feature).
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// // no implicit multiplication, and nesting is limited
+/// let settings = ParserSettings::new()
+///     .commutative_check(false)
+///     .max_stack_depth(10);
+/// let parser = Parser::with_settings(&settings);
+///
+/// assert!(Expression::with_parser("2 * 3", SymbolTable::new(), &parser).is_ok());
+/// assert!(Expression::with_parser("2(3)", SymbolTable::new(), &parser).is_err());
+/// ```
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub struct ParserSettings(CParserSettings);
+
+macro_rules! compile_option {
+    ($name:ident, $flag:ident, $doc:expr) => {
+        #[doc = $doc]
+        pub fn $name(mut self, enable: bool) -> Self {
+            if enable {
+                self.0.compile_options |= $flag;
+            } else {
+                self.0.compile_options &= !$flag;
+            }
+            self
+        }
+    };
 }
 
+impl ParserSettings {
+    /// Returns the default settings of ExprTk: all optimisations and checks
+    /// enabled, variable definitions allowed and default limits (no compile
+    /// timeout and loop budget)
+    pub fn new() -> ParserSettings {
+        ParserSettings(CParserSettings {
+            compile_options: COMPILE_ALL_OPTS,
+            max_stack_depth: 0,
+            max_node_depth: 0,
+            compile_timeout_ns: 0,
+            loop_budget: false,
+        })
+    }
+
+    compile_option!(
+        replacer,
+        COMPILE_REPLACER,
+        "Replaces `true` / `false` with 1 / 0 in the token stream"
+    );
+    compile_option!(
+        joiner,
+        COMPILE_JOINER,
+        "Joins two-character operators which were split into two tokens (e.g. `> =`)"
+    );
+    compile_option!(
+        numeric_check,
+        COMPILE_NUMERIC_CHECK,
+        "Checks numeric literals for validity"
+    );
+    compile_option!(
+        bracket_check,
+        COMPILE_BRACKET_CHECK,
+        "Checks that brackets are balanced before parsing"
+    );
+    compile_option!(
+        sequence_check,
+        COMPILE_SEQUENCE_CHECK,
+        "Checks for invalid sequences of tokens before parsing"
+    );
+    compile_option!(
+        commutative_check,
+        COMPILE_COMMUTATIVE_CHECK,
+        "Inserts implicit multiplication operators (`2x` becomes `2 * x`)"
+    );
+    compile_option!(
+        strength_reduction,
+        COMPILE_STRENGTH_REDUCTION,
+        "Rewrites some combinations of operations into cheaper ones, which \
+        speeds up evaluation at the cost of compile time"
+    );
+
+    /// Allows or disallows variable definitions (`var x := 1`) in formulas. They
+    /// are allowed by default.
+    pub fn variable_definitions(mut self, enable: bool) -> Self {
+        if enable {
+            self.0.compile_options &= !COMPILE_DISABLE_VARDEF;
+        } else {
+            self.0.compile_options |= COMPILE_DISABLE_VARDEF;
+        }
+        self
+    }
+
+    /// Sets the maximum recursion depth of the parser (nesting of
+    /// brackets, function calls, etc.). Zero keeps the ExprTk default.
+    pub fn max_stack_depth(mut self, depth: usize) -> Self {
+        self.0.max_stack_depth = depth as size_t;
+        self
+    }
+
+    /// Sets the maximum depth of the compiled expression tree. Zero keeps the
+    /// ExprTk default.
+    pub fn max_node_depth(mut self, depth: usize) -> Self {
+        self.0.max_node_depth = depth as size_t;
+        self
+    }
+
+    /// Aborts compiling a formula with a `ParseError` if it takes longer than
+    /// `timeout`. There is no timeout by default.
+    pub fn compile_timeout(mut self, timeout: Duration) -> Self {
+        self.0.compile_timeout_ns = duration_ns(timeout).max(1);
+        self
+    }
+
+    /// Compiles `for`, `while` and `repeat` loops with a check of the
+    /// `EvalBudget` (see `Expression::value_with_budget`), which is run in
+    /// every iteration. It is disabled by default, so that loops of other
+    /// expressions do not pay for the check.
+    pub fn loop_budget(mut self, enable: bool) -> Self {
+        self.0.loop_budget = enable;
+        self
+    }
+}
+
+impl Default for ParserSettings {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Maximum number of idle parsers kept per thread by `Parser::with_pooled`.
+/// More than one is only needed if compiling recursively (e.g. from within
+/// a `handle_unknown` closure).
+const PARSER_POOL_SIZE: usize = 4;
+
+thread_local! {
+    static PARSER_POOL: RefCell<Vec<Parser>> = RefCell::new(Vec::new());
+}
+
+/// Wraps the ExprTk parser, which compiles formulae into expressions.
+///
+/// Constructing a parser is relatively expensive, but the same instance can
+/// be used to compile any number of expressions. `Expression::new` and the
+/// other constructors take a parser from a thread-local pool
+/// (see `Parser::with_pooled`), so an explicit instance is only needed
+/// for `Expression::with_parser`.
+///
+/// After every compilation, the parser compiles the constant `0` to drop
+/// its references to the symbol table of the compiled expression. Their
+/// reference count is not atomic, and the expression may be moved to another
+/// thread. This adds a fixed cost to each compilation, which is measured by
+/// the `compile/release` benchmark (`benches/criterion.rs`); it matters most
+/// for very short formulas.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let parser = Parser::new();
+/// for i in 0..10 {
+///     let formula = format!("{} + 1", i);
+///     let mut expr = Expression::with_parser(&formula, SymbolTable::new(), &parser).unwrap();
+///     assert_eq!(expr.value(), i as f64 + 1.);
+/// }
+/// ```
 #[derive(Debug)]
-struct Parser(*mut CParser);
+pub struct Parser(*mut CParser, ParserSettings);
 
 impl Parser {
     pub fn new() -> Parser {
-        unsafe { Parser(parser_new()) }
+        unsafe { Parser(parser_new(), ParserSettings::new()) }
     }
 
-    fn formula_to_cstring(s: &str) -> Result<CString, ParseError> {
-        c_string(s).map_err(From::from)
+    /// Constructs a parser with custom settings (see `ParserSettings`)
+    pub fn with_settings(settings: &ParserSettings) -> Parser {
+        unsafe { Parser(parser_new_with_settings(&settings.0), *settings) }
     }
 
-    pub fn compile(&self, string: &str, expr: &Expression) -> Result<(), ParseError> {
-        let formula = Self::formula_to_cstring(string)?;
+    /// Returns the settings the parser was constructed with
+    pub fn settings(&self) -> &ParserSettings {
+        &self.1
+    }
+
+    /// Calls `func` with a pooled parser if `settings` are the defaults, or
+    /// otherwise with a new parser using them
+    pub(crate) fn with_settings_or_pooled<F, O>(settings: &ParserSettings, func: F) -> O
+    where
+        F: FnOnce(&Parser) -> O,
+    {
+        if *settings == ParserSettings::new() {
+            Self::with_pooled(func)
+        } else {
+            func(&Self::with_settings(settings))
+        }
+    }
+
+    /// Calls `func` with a parser taken from a thread-local pool, and puts
+    /// it back afterwards. A new parser is only constructed if the pool is empty.
+    pub fn with_pooled<F, O>(func: F) -> O
+    where
+        F: FnOnce(&Parser) -> O,
+    {
+        let parser = PARSER_POOL
+            .try_with(|pool| pool.borrow_mut().pop())
+            .ok()
+            .and_then(|p| p)
+            .unwrap_or_else(Parser::new);
+        let out = func(&parser);
+        // If the thread is shutting down, the parser is simply dropped
+        let _ = PARSER_POOL.try_with(|pool| {
+            let mut pool = pool.borrow_mut();
+            if pool.len() < PARSER_POOL_SIZE {
+                pool.push(parser);
+            }
+        });
+        out
+    }
+
+    /// The formula is passed to C++ as (pointer, length) without copying it
+    /// into a `CString`, but null bytes are still rejected.
+    fn check_formula(s: &str) -> Result<(), ParseError> {
+        if s.as_bytes().contains(&0) {
+            return Err(InvalidName(s.to_string()).into());
+        }
+        Ok(())
+    }
+
+    pub(crate) fn compile(&self, string: &str, expr: &mut Expression) -> Result<(), ParseError> {
+        #[cfg(feature = "stats")]
+        let start = Instant::now();
+        self.compile_raw(string, expr.expr)?;
+        expr.settings = self.1;
+        #[cfg(feature = "stats")]
+        self.record_compile(start, expr);
+        Ok(())
+    }
+
+    /// Compiles into an ExprTk expression with its symbol table registered
+    pub(crate) fn compile_raw(
+        &self,
+        string: &str,
+        expr: *mut CExpression,
+    ) -> Result<(), ParseError> {
+        Self::check_formula(string)?;
         unsafe {
-            if !parser_compile(self.0, formula.as_ptr(), expr.expr) {
+            if !parser_compile(self.0, string.as_ptr() as *const c_char, string.len(), expr) {
                 return Err(self.get_err());
             }
         }
         Ok(())
     }
 
-    pub fn compile_resolve<F, S>(
+    pub(crate) fn compile_resolve<F, S>(
         &self,
         string: &str,
         expr: &mut Expression,
@@ -55,14 +334,17 @@ impl Parser {
         F: FnMut(&str, &mut SymbolTable) -> Result<(), S>,
         S: AsRef<str>,
     {
-        let formula = Self::formula_to_cstring(string)?;
+        Self::check_formula(string)?;
+        #[cfg(feature = "stats")]
+        let start = Instant::now();
         let expr_ptr = expr.expr;
         let symbols = expr.symbols_mut();
         let mut user_data = (symbols, &mut func);
         unsafe {
             let r = parser_compile_resolve(
                 self.0,
-                formula.as_ptr(),
+                string.as_ptr() as *const c_char,
+                string.len(),
                 expr_ptr,
                 wrapper::<F, S>,
                 &mut user_data as *const _ as *mut c_void,
@@ -71,6 +353,9 @@ impl Parser {
                 return Err(self.get_err());
             }
         };
+        expr.settings = self.1;
+        #[cfg(feature = "stats")]
+        self.record_compile(start, expr);
 
         extern "C" fn wrapper<F, S>(c_name: *const c_char, user_data: *mut c_void) -> *const c_char
         where
@@ -93,12 +378,66 @@ impl Parser {
         Ok(())
     }
 
+    /// Compiles, creating unknown symbols as variables with value 0 on the
+    /// C++ side. Returns their names and IDs.
+    pub(crate) fn compile_auto_vars(
+        &self,
+        string: &str,
+        expr: &mut Expression,
+    ) -> Result<Vec<(String, usize)>, ParseError> {
+        Self::check_formula(string)?;
+        #[cfg(feature = "stats")]
+        let start = Instant::now();
+        let mut resolved = CResolvedVars::empty();
+        unsafe {
+            if !parser_compile_auto_vars(
+                self.0,
+                string.as_ptr() as *const c_char,
+                string.len(),
+                expr.expr,
+                &mut resolved,
+            ) {
+                return Err(self.get_err());
+            }
+        }
+        expr.settings = self.1;
+        #[cfg(feature = "stats")]
+        self.record_compile(start, expr);
+
+        // the names and pointers are borrowed from the parser
+        let mut vars = Vec::with_capacity(resolved.count);
+        let names = unsafe { resolved.names.as_bytes() };
+        let refs = if resolved.count == 0 {
+            &[]
+        } else {
+            unsafe { slice::from_raw_parts(resolved.refs, resolved.count) }
+        };
+        for (name, &ptr) in names.split(|&b| b == 0).zip(refs) {
+            let name = String::from_utf8_lossy(name).into_owned();
+            let var_id = expr.symbols.push_variable(&name, ptr);
+            vars.push((name, var_id));
+        }
+        Ok(vars)
+    }
+
+    #[cfg(feature = "stats")]
+    fn record_compile(&self, start: Instant, expr: &mut Expression) {
+        let tokens = unsafe { parser_token_count(self.0) };
+        expr.stats.record_compile(start.elapsed(), tokens as usize);
+    }
+
     fn get_err(&self) -> ParseError {
         unsafe { ParseError::from_c_err(self.0) }
             .expect("Compiler notified about error, but there is none.")
     }
 }
 
+impl Default for Parser {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
 impl Drop for Parser {
     fn drop(&mut self) {
         unsafe { parser_destroy(self.0) };
@@ -109,6 +448,10 @@ pub struct Expression {
     expr: *mut CExpression,
     string: String,
     symbols: SymbolTable,
+    // settings of the parser used for compiling, which are reused by clone()
+    settings: ParserSettings,
+    #[cfg(feature = "stats")]
+    stats: Stats,
 }
 
 impl Expression {
@@ -127,14 +470,18 @@ impl Expression {
     /// assert_eq!(expr.value(), 3.);
     /// ```
     pub fn new(string: &str, symbols: SymbolTable) -> Result<Expression, ParseError> {
-        let parser = Parser::new();
-        let e = Expression {
-            expr: unsafe { expression_new() },
-            string: string.to_string(),
-            symbols,
-        };
-        e.register_symbol_table();
-        parser.compile(string, &e)?;
+        Parser::with_pooled(|parser| Expression::with_parser(string, symbols, parser))
+    }
+
+    /// Compiles a new `Expression` like `Expression::new`, but using the supplied
+    /// `Parser` instead of one from the thread-local pool.
+    pub fn with_parser(
+        string: &str,
+        symbols: SymbolTable,
+        parser: &Parser,
+    ) -> Result<Expression, ParseError> {
+        let mut e = Expression::uncompiled(string, symbols);
+        parser.compile(string, &mut e)?;
         Ok(e)
     }
 
@@ -142,19 +489,25 @@ impl Expression {
     /// unknown variables are encountered, they are automatically added an internal `SymbolTable`
     /// and initialized with `0.`. Their names and variable IDs are returned as tuples together
     /// with the new `Expression` instance.
+    ///
+    /// The variables are created by ExprTk itself without calling back into Rust
+    /// for every name, which is faster than doing the same with `handle_unknown`.
     pub fn parse_vars(
         string: &str,
         symbols: SymbolTable,
     ) -> Result<(Expression, Vec<(String, usize)>), ParseError> {
-        let mut vars = vec![];
-        let e = Expression::handle_unknown(string, symbols, |name, symbols| {
-            let var_id = symbols
-                .add_variable(name, 0.)
-                .map_err(|_| "invalid name.")?
-                .unwrap();
-            vars.push((name.to_string(), var_id));
-            Ok(())
-        })?;
+        Parser::with_pooled(|parser| Expression::parse_vars_with_parser(string, symbols, parser))
+    }
+
+    /// Compiles a new `Expression` like `Expression::parse_vars`, but using the
+    /// supplied `Parser` instead of one from the thread-local pool.
+    pub fn parse_vars_with_parser(
+        string: &str,
+        symbols: SymbolTable,
+        parser: &Parser,
+    ) -> Result<(Expression, Vec<(String, usize)>), ParseError> {
+        let mut e = Expression::uncompiled(string, symbols);
+        let vars = parser.compile_auto_vars(string, &mut e)?;
         Ok((e, vars))
     }
 
@@ -191,23 +544,29 @@ impl Expression {
     where
         F: FnMut(&str, &mut SymbolTable) -> Result<(), String>,
     {
-        let parser = Parser::new();
-        let mut e = Expression {
-            expr: unsafe { expression_new() },
-            string: string.to_string(),
-            symbols,
-        };
-        e.register_symbol_table();
+        Parser::with_pooled(|parser| {
+            let mut e = Expression::uncompiled(string, symbols);
 
-        parser.compile_resolve(string, &mut e, func)?;
+            parser.compile_resolve(string, &mut e, func)?;
 
-        Ok(e)
+            Ok(e)
+        })
     }
 
-    fn register_symbol_table(&self) {
+    // New expression with the symbol table registered, to be compiled
+    fn uncompiled(string: &str, symbols: SymbolTable) -> Expression {
+        let e = Expression {
+            expr: unsafe { expression_new() },
+            string: string.to_string(),
+            symbols,
+            settings: ParserSettings::new(),
+            #[cfg(feature = "stats")]
+            stats: Stats::default(),
+        };
         unsafe {
-            expression_register_symbol_table(self.expr, self.symbols.sym);
+            expression_register_symbol_table(e.expr, e.symbols.sym);
         }
+        e
     }
 
     /// Calculates the value of the expression. Returns `NaN` if the expression was not yet
@@ -217,7 +576,159 @@ impl Expression {
     /// object, since executing an expression can have side-effects. Variables
     /// in the symbol table of the expression can be changed or added.
     pub fn value(&mut self) -> c_double {
-        unsafe { expression_value(self.expr) }
+        #[cfg(feature = "stats")]
+        {
+            let start = Instant::now();
+            let v = unsafe { expression_value(self.expr) };
+            self.stats.record_eval(start.elapsed());
+            v
+        }
+        #[cfg(not(feature = "stats"))]
+        unsafe {
+            expression_value(self.expr)
+        }
+    }
+
+    /// Calculates the value of the expression like `Expression::value`, but
+    /// stops with an error if the evaluation exceeds the limits of `budget`:
+    /// the number of loop iterations, the deadline or cancellation.
+    ///
+    /// The limits are checked in every iteration of `for`, `while` and `repeat`
+    /// loops (the deadline only every 1024 iterations), which is the only way a
+    /// formula can run for an unbounded time. The iteration count starts at zero
+    /// for each call. Assignments made before stopping are not reverted.
+    ///
+    /// The loops must be compiled with a parser created with
+    /// `ParserSettings::loop_budget(true)`. Otherwise, the budget is only
+    /// checked before starting the evaluation.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let parser = Parser::with_settings(&ParserSettings::new().loop_budget(true));
+    /// let (mut expr, _) =
+    ///     Expression::parse_vars_with_parser("while (x < 1e9) { x += 1 }", SymbolTable::new(), &parser)
+    ///         .unwrap();
+    /// let budget = EvalBudget::new().max_iterations(10000);
+    /// assert_eq!(expr.value_with_budget(&budget), Err(EvalError::IterationLimit));
+    /// ```
+    pub fn value_with_budget(&mut self, budget: &EvalBudget) -> Result<c_double, EvalError> {
+        let mut b = budget.to_c()?;
+        #[cfg(feature = "stats")]
+        let start = Instant::now();
+        let v = unsafe { expression_value_budget(self.expr, &mut b) };
+        #[cfg(feature = "stats")]
+        self.stats.record_eval(start.elapsed());
+        match EvalError::from_status(b.status) {
+            Some(e) => Err(e),
+            None => Ok(v),
+        }
+    }
+
+    /// Returns the compilation and evaluation statistics of the expression
+    /// (requires the `stats` feature).
+    #[cfg(feature = "stats")]
+    pub fn stats(&self) -> &Stats {
+        &self.stats
+    }
+
+    /// Resets the statistics (requires the `stats` feature)
+    #[cfg(feature = "stats")]
+    pub fn reset_stats(&mut self) {
+        self.stats = Stats::default();
+    }
+
+    /// Evaluates the expression once for every row of columnar input, writing the
+    /// results to `out`. `columns` contains pairs of variable IDs and value slices;
+    /// for row `i`, each variable is set to the `i`-th element of its column before
+    /// evaluating. All rows are processed in a single call to the C++ library.
+    ///
+    /// After the call, the variables keep the values of the last row. Variables
+    /// without a column keep their current value throughout.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+    /// let y_id = symbol_table.add_variable("y", 0.).unwrap().unwrap();
+    /// let mut expr = Expression::new("x * y + 1", symbol_table).unwrap();
+    ///
+    /// let x = [1., 2., 3.];
+    /// let y = [4., 5., 6.];
+    /// let mut out = [0.; 3];
+    /// expr.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+    /// assert_eq!(out, [5., 11., 19.]);
+    /// ```
+    pub fn eval_batch(&mut self, columns: &[(usize, &[c_double])], out: &mut [c_double]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    /// Evaluates the expression for every row of single precision columnar
+    /// input like `eval_batch`. The values are converted to `f64` row by row
+    /// while evaluating, so no temporary buffers are needed. The computation
+    /// itself is done in double precision.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+    /// let mut expr = Expression::new("x / 2", symbol_table).unwrap();
+    ///
+    /// let x = [1f32, 2., 3.];
+    /// let mut out = [0f32; 3];
+    /// expr.eval_batch_f32(&[(x_id, &x)], &mut out);
+    /// assert_eq!(out, [0.5, 1., 1.5]);
+    /// ```
+    pub fn eval_batch_f32(&mut self, columns: &[(usize, &[f32])], out: &mut [f32]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    pub(crate) fn eval_batch_generic<T: BatchValue>(
+        &mut self,
+        columns: &[(usize, &[T])],
+        out: &mut [T],
+    ) {
+        let mut vars = Vec::with_capacity(columns.len());
+        let mut data = Vec::with_capacity(columns.len());
+        for &(var_id, column) in columns {
+            assert_eq!(
+                column.len(),
+                out.len(),
+                "Column length does not match the output length"
+            );
+            let var_ptr = self
+                .symbols
+                .values
+                .get(var_id)
+                .expect("Invalid variable ID");
+            vars.push(*var_ptr);
+            data.push(column.as_ptr());
+        }
+        unsafe {
+            T::value_batch(
+                self.expr,
+                vars.as_ptr(),
+                data.as_ptr(),
+                columns.len() as size_t,
+                out.len() as size_t,
+                out.as_mut_ptr(),
+            )
+        }
     }
 
     /// Returns a reference to the symbol table owned by the `Expression`
@@ -231,8 +742,102 @@ impl Expression {
     pub fn symbols_mut(&mut self) -> &mut SymbolTable {
         &mut self.symbols
     }
+
+    /// Returns the formula the expression was compiled from
+    #[inline]
+    pub fn formula(&self) -> &str {
+        &self.string
+    }
+
+    /// Returns a rough estimate of the number of bytes of memory used by the
+    /// expression, including its symbol table. It is a heuristic, not a
+    /// measurement: ExprTk does not expose the size of its node tree, which
+    /// is assumed to grow with the length of the formula, and the C++ symbol
+    /// table is estimated from the number of symbols.
+    ///
+    /// Many expressions using the same symbols take less memory as
+    /// `CompactExpression`.
+    pub fn estimated_memory_usage(&self) -> usize {
+        mem::size_of::<Expression>()
+            + self.string.capacity()
+            + EXPRESSION_BYTES
+            + self.string.len() * NODE_BYTES_PER_CHAR
+            + self.symbols.estimated_memory_usage()
+    }
+}
+
+/// Element type of columns and outputs of the batch evaluation methods
+/// (`f64` or `f32`). Expressions are always evaluated in double precision.
+pub(crate) trait BatchValue: Copy + Send + Sync {
+    fn to_f64(self) -> c_double;
+    fn from_f64(v: c_double) -> Self;
+    unsafe fn value_batch(
+        e: *mut CExpression,
+        vars: *const *mut c_double,
+        columns: *const *const Self,
+        n_vars: size_t,
+        n_rows: size_t,
+        out: *mut Self,
+    );
+}
+
+impl BatchValue for c_double {
+    #[inline]
+    fn to_f64(self) -> c_double {
+        self
+    }
+
+    #[inline]
+    fn from_f64(v: c_double) -> Self {
+        v
+    }
+
+    unsafe fn value_batch(
+        e: *mut CExpression,
+        vars: *const *mut c_double,
+        columns: *const *const Self,
+        n_vars: size_t,
+        n_rows: size_t,
+        out: *mut Self,
+    ) {
+        expression_value_batch(e, vars, columns, n_vars, n_rows, out)
+    }
 }
 
+impl BatchValue for f32 {
+    #[inline]
+    fn to_f64(self) -> c_double {
+        c_double::from(self)
+    }
+
+    #[inline]
+    fn from_f64(v: c_double) -> Self {
+        v as f32
+    }
+
+    unsafe fn value_batch(
+        e: *mut CExpression,
+        vars: *const *mut c_double,
+        columns: *const *const Self,
+        n_vars: size_t,
+        n_rows: size_t,
+        out: *mut Self,
+    ) {
+        expression_value_batch_f32(e, vars, columns, n_vars, n_rows, out)
+    }
+}
+
+// Heuristics for the memory used on the C++ side (not measured), for
+// estimated_memory_usage():
+// exprtk::expression<double> with its control block
+pub(crate) const EXPRESSION_BYTES: usize = 128;
+// node tree, per character of the formula
+pub(crate) const NODE_BYTES_PER_CHAR: usize = 16;
+// exprtk::symbol_table<double> with its (initially empty) maps
+const SYMBOL_TABLE_BYTES: usize = 1024;
+// entry of a symbol in one of the maps of the symbol table
+const SYMBOL_BYTES: usize = 96;
+
 impl Drop for Expression {
     fn drop(&mut self) {
         unsafe { expression_destroy(self.expr) };
@@ -249,17 +854,180 @@ impl fmt::Debug for Expression {
     }
 }
 
+impl Expression {
+    /// Returns `n` clones, compiled with one parser using the settings of
+    /// the original
+    pub(crate) fn clones(&self, n: usize) -> Vec<Expression> {
+        Parser::with_settings_or_pooled(&self.settings, |parser| {
+            (0..n).map(|_| self.clone_with(parser)).collect()
+        })
+    }
+
+    fn clone_with(&self, parser: &Parser) -> Expression {
+        Expression::with_parser(&self.string, self.symbols.clone(), parser).unwrap()
+    }
+}
+
+/// The clone is compiled again from the formula, with the settings of the
+/// parser used for the original (see `ParserSettings`).
+///
+/// # Panics
+///
+/// Panics if the recompilation fails, which is only possible if the original
+/// was compiled with a `ParserSettings::compile_timeout` and the clone takes
+/// longer.
 impl Clone for Expression {
     fn clone(&self) -> Expression {
-        Expression::new(&self.string, self.symbols.clone()).unwrap()
+        Parser::with_settings_or_pooled(&self.settings, |parser| self.clone_with(parser))
+    }
+}
+
+/// Maximum number of arguments of functions added with `add_vec_func`
+pub(crate) const MAX_VEC_FUNC_ARGS: usize = 10;
+
+/// Function added with `add_vec_func`
+trait VecFunc {
+    fn call(&self, args: &[&[c_double]], out: &mut [c_double]);
+    fn box_clone(&self) -> Box<dyn VecFunc>;
+}
+
+impl<F> VecFunc for F
+where
+    F: Fn(&[&[c_double]], &mut [c_double]) + Clone + 'static,
+{
+    #[inline]
+    fn call(&self, args: &[&[c_double]], out: &mut [c_double]) {
+        self(args, out)
+    }
+
+    fn box_clone(&self) -> Box<dyn VecFunc> {
+        Box::new(self.clone())
+    }
+}
+
+struct VecFuncData {
+    name: String,
+    n_args: usize,
+    cpp_func: *mut c_void,
+    // boxed twice, since a thin pointer is passed to C++
+    func: Box<Box<dyn VecFunc>>,
+}
+
+impl Drop for VecFuncData {
+    fn drop(&mut self) {
+        unsafe { symbol_table_free_vec_func(self.cpp_func) };
+    }
+}
+
+/// Argument of a function added with `SymbolTable::add_generic_func`. It
+/// refers to the data of the scalar, vector or string without copying.
+#[repr(transparent)]
+pub struct GenericArg(CGenericArg);
+
+/// Value of a `GenericArg`
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum GenericValue<'a> {
+    Scalar(c_double),
+    Vector(&'a [c_double]),
+    String(&'a [u8]),
+}
+
+impl GenericArg {
+    #[inline]
+    pub fn value(&self) -> GenericValue<'_> {
+        unsafe {
+            match self.0.kind {
+                GENERIC_SCALAR => GenericValue::Scalar(*(self.0.data as *const c_double)),
+                GENERIC_VECTOR => GenericValue::Vector(slice::from_raw_parts(
+                    self.0.data as *const c_double,
+                    self.0.size as usize,
+                )),
+                GENERIC_STRING => GenericValue::String(slice::from_raw_parts(
+                    self.0.data as *const u8,
+                    self.0.size as usize,
+                )),
+                k => panic!("Bug: unknown type of generic argument: {}", k),
+            }
+        }
     }
+
+    /// Returns the value if the argument is a scalar
+    #[inline]
+    pub fn scalar(&self) -> Option<c_double> {
+        match self.value() {
+            GenericValue::Scalar(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    /// Returns the values if the argument is a vector
+    #[inline]
+    pub fn vector(&self) -> Option<&[c_double]> {
+        match self.value() {
+            GenericValue::Vector(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    /// Returns the bytes if the argument is a string
+    #[inline]
+    pub fn string(&self) -> Option<&[u8]> {
+        match self.value() {
+            GenericValue::String(s) => Some(s),
+            _ => None,
+        }
+    }
+}
+
+impl fmt::Debug for GenericArg {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        self.value().fmt(f)
+    }
+}
+
+/// Options for functions added with `add_func1` to `add_func10`,
+/// `add_vararg_func` and `add_generic_func`.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub struct FunctionOptions {
+    /// If `false` (the default), the function is assumed to be pure, i.e. the
+    /// result only depends on the arguments. Calls with only constant
+    /// arguments are then evaluated once by the ExprTk optimizer at compile
+    /// time (constant folding). If `true`, the function is called on every
+    /// evaluation.
+    pub has_side_effects: bool,
 }
 
+impl FunctionOptions {
+    /// Options for pure functions (the default)
+    pub fn pure() -> FunctionOptions {
+        FunctionOptions {
+            has_side_effects: false,
+        }
+    }
+
+    /// Options for functions with side effects, which are never folded
+    pub fn with_side_effects() -> FunctionOptions {
+        FunctionOptions {
+            has_side_effects: true,
+        }
+    }
+}
+
+impl Default for FunctionOptions {
+    fn default() -> Self {
+        Self::pure()
+    }
+}
+
+type CloneFunc =
+    fn(&str, *mut c_void, FunctionOptions, &mut SymbolTable) -> Result<bool, InvalidName>;
+
 struct FuncData {
     name: String,
+    options: FunctionOptions,
     cpp_func: *mut c_void,
     rust_closure: *mut c_void,
-    clone_func: fn(&str, *mut c_void, &mut SymbolTable) -> Result<bool, InvalidName>,
+    clone_func: CloneFunc,
     free_cpp_func: unsafe extern "C" fn(*mut c_void),
     free_closure_func: fn(*mut c_void),
 }
@@ -270,11 +1038,135 @@ struct FuncData {
 /// Many but not all of the methods of the [ExprTk symbol_table](http://partow.net/programming/exprtk/doxygen/classexprtk_1_1symbol__table.html)
 /// were implemented, and the API is sometimes different.
 pub struct SymbolTable {
-    sym: *mut CSymbolTable,
+    pub(crate) sym: *mut CSymbolTable,
     values: Vec<*mut c_double>,
     strings: Vec<StringValue>,
-    vectors: Vec<Box<[c_double]>>,
+    vectors: Vec<VectorData>,
     funcs: Vec<FuncData>,
+    vec_funcs: Vec<VecFuncData>,
+    // Names in the order of the IDs, and named constants. They allow
+    // cloning without querying the C++ symbol table.
+    var_names: Vec<String>,
+    string_names: Vec<String>,
+    vector_names: Vec<String>,
+    constants: Vec<(String, c_double)>,
+    // Lookup of IDs by name (see `name_key`)
+    var_ids: HashMap<String, usize>,
+    string_ids: HashMap<String, usize>,
+    vector_ids: HashMap<String, usize>,
+    // Contiguous storage of the first `var_block_len` variables
+    // (see `with_variable_block`)
+    var_block: Vec<CacheLine>,
+    var_block_len: usize,
+    // Records with fields bound to variables (see `bind_row`)
+    rows: Vec<RowData>,
+}
+
+struct RowData {
+    buf: Vec<CacheLine>,
+    type_id: TypeId,
+    // (variable ID, offset in bytes)
+    fields: Vec<(usize, usize)>,
+}
+
+impl RowData {
+    #[inline]
+    fn ptr(&self) -> *mut u8 {
+        self.buf.as_ptr() as *mut u8
+    }
+}
+
+/// Handle to a record of type `R` stored in a `SymbolTable`, whose fields are
+/// bound to variables (see `SymbolTable::bind_row`). It remains valid for
+/// clones of the symbol table.
+pub struct RowBinding<R> {
+    row: usize,
+    var_ids: Vec<usize>,
+    _row: PhantomData<fn() -> R>,
+}
+
+impl<R> RowBinding<R> {
+    /// Returns the variable IDs of the bound fields (in the order given to
+    /// `bind_row`)
+    pub fn var_ids(&self) -> &[usize] {
+        &self.var_ids
+    }
+}
+
+impl<R> Clone for RowBinding<R> {
+    fn clone(&self) -> Self {
+        RowBinding {
+            row: self.row,
+            var_ids: self.var_ids.clone(),
+            _row: PhantomData,
+        }
+    }
+}
+
+impl<R> fmt::Debug for RowBinding<R> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(
+            f,
+            "RowBinding {{ row: {}, var_ids: {:?} }}",
+            self.row, self.var_ids
+        )
+    }
+}
+
+const VALUES_PER_LINE: usize = 8;
+
+/// Cache line of the variable block
+#[derive(Clone, Copy)]
+#[repr(C, align(64))]
+struct CacheLine([c_double; VALUES_PER_LINE]);
+
+/// Storage of a vector variable
+enum VectorData {
+    /// Values copied into the symbol table by `add_vector`
+    Owned(Box<[c_double]>),
+    /// Caller-owned buffer registered through an `exprtk::vector_view`
+    /// by `add_vector_view`. `len` is the current size, `base_len` the size
+    /// at registration time, which is the maximum for `rebind_vector`.
+    View {
+        view: *mut CVectorView,
+        ptr: *mut c_double,
+        len: usize,
+        base_len: usize,
+    },
+}
+
+impl VectorData {
+    #[inline]
+    fn as_ptr(&self) -> *const c_double {
+        match *self {
+            VectorData::Owned(ref v) => v.as_ptr(),
+            VectorData::View { ptr, .. } => ptr,
+        }
+    }
+
+    #[inline]
+    fn as_slice(&self) -> &[c_double] {
+        match *self {
+            VectorData::Owned(ref v) => v,
+            VectorData::View { ptr, len, .. } => unsafe { slice::from_raw_parts(ptr, len) },
+        }
+    }
+
+    #[inline]
+    fn as_mut_slice(&mut self) -> &mut [c_double] {
+        match *self {
+            VectorData::Owned(ref mut v) => v,
+            VectorData::View { ptr, len, .. } => unsafe { slice::from_raw_parts_mut(ptr, len) },
+        }
+    }
+}
+
+impl Drop for VectorData {
+    fn drop(&mut self) {
+        if let VectorData::View { view, .. } = *self {
+            unsafe { vector_view_destroy(view) };
+        }
+    }
 }
 
 impl SymbolTable {
@@ -285,14 +1177,312 @@ impl SymbolTable {
             strings: vec![],
             vectors: vec![],
             funcs: vec![],
+            vec_funcs: vec![],
+            var_names: vec![],
+            string_names: vec![],
+            vector_names: vec![],
+            constants: vec![],
+            var_ids: HashMap::new(),
+            string_ids: HashMap::new(),
+            vector_ids: HashMap::new(),
+            var_block: vec![],
+            var_block_len: 0,
+            rows: vec![],
+        }
+    }
+
+    /// Creates a symbol table with variables stored in one contiguous block of
+    /// memory, which is aligned to cache lines (64 bytes). The variables receive
+    /// the IDs `0..names.len()` in the order of `names` and are initialized
+    /// with `0.`. Like other variables, they can be accessed by ID, but also
+    /// all at once with `variable_block` / `variable_block_mut`, so a whole row
+    /// of input values can be set with a single `copy_from_slice`.
+    ///
+    /// Further variables can be added with `add_variable`, but are not part
+    /// of the block. Returns `Err(InvalidName)` if a name is invalid or occurs
+    /// twice.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let symbol_table = SymbolTable::with_variable_block(&["a", "b", "c"]).unwrap();
+    /// let mut expr = Expression::new("a + 2 * b + 3 * c", symbol_table).unwrap();
+    ///
+    /// for row in &[[1., 2., 3.], [4., 5., 6.]] {
+    ///     expr.symbols_mut().variable_block_mut().copy_from_slice(row);
+    ///     println!("{}", expr.value());
+    /// }
+    /// assert_eq!(expr.value(), 32.);
+    /// ```
+    pub fn with_variable_block<S: AsRef<str>>(names: &[S]) -> Result<SymbolTable, InvalidName> {
+        let mut s = Self::new();
+        s.var_block = vec![
+            CacheLine([0.; VALUES_PER_LINE]);
+            (names.len() + VALUES_PER_LINE - 1) / VALUES_PER_LINE
+        ];
+        s.var_block_len = names.len();
+        let base = s.var_block.as_mut_ptr() as *mut c_double;
+        for (i, name) in names.iter().enumerate() {
+            let name = name.as_ref();
+            unsafe { s.add_external_variable(name, base.add(i))? };
         }
+        Ok(s)
+    }
+
+    /// Adds a variable referring to memory owned by the symbol table. Returns
+    /// `Err(InvalidName)` if the name is invalid or already present.
+    unsafe fn add_external_variable(
+        &mut self,
+        name: &str,
+        ptr: *mut c_double,
+    ) -> Result<usize, InvalidName> {
+        let (n, l) = c_name(name)?;
+        let rv = symbol_table_add_variable(self.sym, n, l, ptr, false);
+        if self.validate_added(name, rv, ())?.is_none() {
+            return Err(InvalidName(name.to_string()));
+        }
+        Ok(self.push_variable(name, ptr))
+    }
+
+    /// Stores a copy of the record `init` in the symbol table and adds
+    /// variables, which directly refer to the given `f64` fields of the record.
+    /// The fields are selected by functions returning a reference to them.
+    /// Setting a new row (`set_row`) is then a single copy of the whole record,
+    /// or the record can be modified in place (`row_mut`), e.g. by reading
+    /// into it directly. The variable IDs are available from the returned
+    /// `RowBinding`.
+    ///
+    /// Returns `Err(InvalidName)` if a name is invalid, already present or
+    /// given twice, in which case none of the fields are bound.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a function returns a reference outside of
+    /// the record, or if `R` requires an alignment of more than 64 bytes.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// #[derive(Clone, Copy, Default)]
+    /// #[repr(C)]
+    /// struct Record {
+    ///     id: u32,
+    ///     a: f64,
+    ///     b: f64,
+    /// }
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// let binding = symbol_table.bind_row(Record::default(), &[
+    ///     ("a", |r: &Record| &r.a),
+    ///     ("b", |r: &Record| &r.b),
+    /// ]).unwrap();
+    /// let mut expr = Expression::new("a * b", symbol_table).unwrap();
+    ///
+    /// let records = [Record { id: 1, a: 2., b: 3. }, Record { id: 2, a: 4., b: 5. }];
+    /// let mut results = vec![];
+    /// for r in &records {
+    ///     expr.symbols_mut().set_row(&binding, r);
+    ///     results.push(expr.value());
+    /// }
+    /// assert_eq!(results, [6., 20.]);
+    /// ```
+    pub fn bind_row<R>(
+        &mut self,
+        init: R,
+        fields: &[(&str, fn(&R) -> &c_double)],
+    ) -> Result<RowBinding<R>, InvalidName>
+    where
+        R: Copy + Send + Sync + 'static,
+    {
+        let base = &init as *const R as usize;
+        let offsets: Vec<_> = fields
+            .iter()
+            .map(|&(name, field)| {
+                let offset = (field(&init) as *const c_double as usize).wrapping_sub(base);
+                assert!(
+                    offset
+                        .checked_add(mem::size_of::<c_double>())
+                        .map_or(false, |end| end <= mem::size_of::<R>()),
+                    "The field '{}' is not part of the record",
+                    name
+                );
+                (name, offset)
+            })
+            .collect();
+        unsafe { self.bind_row_offsets(init, &offsets) }
+    }
+
+    /// Like `bind_row`, but the fields are given as offsets in bytes from the
+    /// start of the record.
+    ///
+    /// # Safety
+    ///
+    /// Every offset must point to an `f64` field of `R`.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if an offset is outside of the record or not
+    /// aligned, or if `R` requires an alignment of more than 64 bytes.
+    pub unsafe fn bind_row_offsets<R>(
+        &mut self,
+        init: R,
+        fields: &[(&str, usize)],
+    ) -> Result<RowBinding<R>, InvalidName>
+    where
+        R: Copy + Send + Sync + 'static,
+    {
+        assert!(
+            mem::align_of::<R>() <= mem::align_of::<CacheLine>(),
+            "The alignment of the record type is too large"
+        );
+        let size = mem::size_of::<R>();
+        // everything is checked before adding any variable
+        for (i, &(name, offset)) in fields.iter().enumerate() {
+            assert!(
+                offset % mem::align_of::<c_double>() == 0
+                    && offset + mem::size_of::<c_double>() <= size,
+                "Invalid offset of field '{}': {}",
+                name,
+                offset
+            );
+            let key = name_key(name);
+            if self.symbol_exists(name)? || fields[..i].iter().any(|&(n, _)| name_key(n) == key) {
+                return Err(InvalidName(name.to_string()));
+            }
+        }
+        let n_lines = (size + mem::size_of::<CacheLine>() - 1) / mem::size_of::<CacheLine>();
+        let mut buf = vec![CacheLine([0.; VALUES_PER_LINE]); n_lines.max(1)];
+        ptr::write(buf.as_mut_ptr() as *mut R, init);
+        let row_ptr = buf.as_mut_ptr() as *mut u8;
+
+        let n_vars = self.values.len();
+        let mut row_fields = Vec::with_capacity(fields.len());
+        for &(name, offset) in fields {
+            // ExprTk can still reject the syntax of a name
+            match self.add_external_variable(name, row_ptr.add(offset) as *mut c_double) {
+                Ok(var_id) => row_fields.push((var_id, offset)),
+                Err(e) => {
+                    self.remove_variables_from(n_vars);
+                    return Err(e);
+                }
+            }
+        }
+        let var_ids = row_fields.iter().map(|&(var_id, _)| var_id).collect();
+        let row = self.rows.len();
+        self.rows.push(RowData {
+            buf,
+            type_id: TypeId::of::<R>(),
+            fields: row_fields,
+        });
+        Ok(RowBinding {
+            row,
+            var_ids,
+            _row: PhantomData,
+        })
+    }
+
+    // Removes the variables with IDs from `var_id` on, which must have been
+    // added last
+    fn remove_variables_from(&mut self, var_id: usize) {
+        while self.values.len() > var_id {
+            let name = self.var_names.pop().unwrap();
+            self.values.pop();
+            self.var_ids.remove(name_key(&name).as_ref());
+            let (n, l) = c_name(&name).unwrap();
+            let removed = unsafe { symbol_table_remove_variable(self.sym, n, l) };
+            assert!(removed, "Bug: variable '{}' not removed", name);
+        }
+    }
+
+    #[inline]
+    fn row_data<R: 'static>(&self, binding: &RowBinding<R>) -> &RowData {
+        let row = self.rows.get(binding.row).expect("Invalid row binding");
+        assert!(
+            row.type_id == TypeId::of::<R>(),
+            "Row binding does not belong to this symbol table"
+        );
+        row
+    }
+
+    /// Returns the record bound with `bind_row`
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the binding was not created by this symbol
+    /// table (or the one it was cloned from).
+    #[inline]
+    pub fn row<R: 'static>(&self, binding: &RowBinding<R>) -> &R {
+        unsafe { &*(self.row_data(binding).ptr() as *const R) }
+    }
+
+    /// Returns the record bound with `bind_row` for modification. Changes
+    /// of the bound fields are directly visible to expressions.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the binding was not created by this symbol
+    /// table (or the one it was cloned from).
+    #[inline]
+    pub fn row_mut<R: 'static>(&mut self, binding: &RowBinding<R>) -> &mut R {
+        unsafe { &mut *(self.row_data(binding).ptr() as *mut R) }
+    }
+
+    /// Copies a record into the one bound with `bind_row`
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the binding was not created by this symbol
+    /// table (or the one it was cloned from).
+    #[inline]
+    pub fn set_row<R: Copy + 'static>(&mut self, binding: &RowBinding<R>, row: &R) {
+        *self.row_mut(binding) = *row;
+    }
+
+    /// Returns the values of the variables created by `with_variable_block`
+    /// (in the order of their IDs), or an empty slice if there is no block.
+    #[inline]
+    pub fn variable_block(&self) -> &[c_double] {
+        let ptr = self.var_block.as_ptr() as *const c_double;
+        unsafe { slice::from_raw_parts(ptr, self.var_block_len) }
+    }
+
+    /// Returns the values of the variables created by `with_variable_block`
+    /// for modification.
+    #[inline]
+    pub fn variable_block_mut(&mut self) -> &mut [c_double] {
+        let ptr = self.var_block.as_mut_ptr() as *mut c_double;
+        unsafe { slice::from_raw_parts_mut(ptr, self.var_block_len) }
     }
 
     pub fn add_constant(&mut self, name: &str, value: c_double) -> Result<bool, InvalidName> {
-        let c_name = c_string(name)?;
-        let rv = unsafe { symbol_table_add_constant(self.sym, c_name.as_ptr(), value) };
-        let added = self.validate_added(name, rv, ())?;
-        Ok(added.is_some())
+        let (n, l) = c_name(name)?;
+        let rv = unsafe { symbol_table_add_constant(self.sym, n, l, value) };
+        let added = self.validate_added(name, rv, ())?.is_some();
+        if added {
+            self.constants.push((name.to_string(), value));
+        }
+        Ok(added)
+    }
+
+    // Registers a constant added by ExprTk (pi, epsilon, etc.)
+    fn add_builtin_constant(&mut self, name: &str, added: bool) -> bool {
+        if added {
+            let value = self.value_from_name(name).unwrap();
+            self.constants.push((name.to_string(), value));
+        }
+        added
+    }
+
+    /// Returns the value of a constant added with `add_constant` or one of the
+    /// builtin constants (`add_pi`, etc.)
+    pub(crate) fn constant_value(&self, name: &str) -> Option<c_double> {
+        let key = name_key(name);
+        self.constants
+            .iter()
+            .find(|c| name_key(&c.0) == key)
+            .map(|c| c.1)
     }
 
     /// Adds a new variable. Returns the variable ID that can later be used for `set_value`
@@ -306,15 +1496,24 @@ impl SymbolTable {
         value: c_double,
     ) -> Result<Option<usize>, InvalidName> {
         let var_id = self.values.len();
-        let c_name = c_string(name)?;
-        let rv =
-            unsafe { symbol_table_create_variable(self.sym, c_name.as_ptr(), value as c_double) };
+        let (n, l) = c_name(name)?;
+        let rv = unsafe { symbol_table_create_variable(self.sym, n, l, value as c_double) };
         let res = self.validate_added(name, rv, var_id)?;
-        let ptr = unsafe { symbol_table_variable_ref(self.sym, c_name.as_ptr()) };
-        self.values.push(ptr);
+        if res.is_some() {
+            let ptr = unsafe { symbol_table_variable_ref(self.sym, n, l) };
+            self.push_variable(name, ptr);
+        }
         Ok(res)
     }
 
+    fn push_variable(&mut self, name: &str, ptr: *mut c_double) -> usize {
+        let var_id = self.values.len();
+        self.var_ids.insert(name_key(name).into_owned(), var_id);
+        self.values.push(ptr);
+        self.var_names.push(name.to_string());
+        var_id
+    }
+
     #[allow(clippy::mut_from_ref)]
     #[inline]
     unsafe fn _value_mut(&self, var_id: usize) -> &mut c_double {
@@ -390,6 +1589,13 @@ impl SymbolTable {
         Cell::from_mut(mut_ref)
     }
 
+    /// Returns the pointers to the values of all variables in the order of their IDs
+    #[cfg(feature = "jit")]
+    #[inline]
+    pub(crate) fn value_ptrs(&self) -> *const *mut c_double {
+        self.values.as_ptr()
+    }
+
     /// Returns the value of a variable (whether constant or not)
     ///
     /// # Panics
@@ -397,86 +1603,284 @@ impl SymbolTable {
     /// This function will panic if the `name` refers to an unknown variable.
     #[inline]
     pub fn value_from_name(&self, name: &str) -> Result<c_double, InvalidName> {
-        let c_name = c_string(name)?;
-        let var_ref = unsafe {
-            symbol_table_variable_ref(self.sym, c_name.as_ptr())
-                .as_ref()
-                .cloned()
-        };
+        if let Some(var_id) = self.get_var_id(name)? {
+            return Ok(self.value(var_id));
+        }
+        // constants are not registered with an ID
+        let (n, l) = c_name(name)?;
+        let var_ref = unsafe { symbol_table_variable_ref(self.sym, n, l).as_ref().cloned() };
         Ok(var_ref.expect("Unknown variable name"))
     }
 
     /// Adds a new string variable. Returns the variable ID that can later be used for `set_string`
     /// or `None` if a variable with the same name was already present.
     pub fn add_stringvar(&mut self, name: &str, text: &str) -> Result<Option<usize>, InvalidName> {
+        self.add_stringvar_bytes(name, text.as_bytes(), 0)
+    }
+
+    /// Adds a new string variable like `add_stringvar`, with space reserved for
+    /// at least `capacity` bytes. Setting values up to this length with
+    /// `set_string` or `StringValue::set` / `set_bytes` will not allocate.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// let s_id = symbol_table.add_stringvar_with_capacity("s", "", 128).unwrap().unwrap();
+    /// let mut expr = Expression::new("s like '*error*'", symbol_table).unwrap();
+    ///
+    /// for line in &[&b"info: started"[..], b"error: not found"] {
+    ///     expr.symbols_mut().string_mut(s_id).set_bytes(line);
+    ///     println!("{}", expr.value());
+    /// }
+    /// assert_eq!(expr.symbols().string(s_id).get_bytes(), b"error: not found");
+    /// assert_eq!(expr.value(), 1.);
+    /// ```
+    pub fn add_stringvar_with_capacity(
+        &mut self,
+        name: &str,
+        text: &str,
+        capacity: usize,
+    ) -> Result<Option<usize>, InvalidName> {
+        self.add_stringvar_bytes(name, text.as_bytes(), capacity)
+    }
+
+    fn add_stringvar_bytes(
+        &mut self,
+        name: &str,
+        text: &[u8],
+        capacity: usize,
+    ) -> Result<Option<usize>, InvalidName> {
+        let (n, l) = c_name(name)?;
         let i = self.strings.len();
-        let s = StringValue::new(text);
+        let mut s = StringValue::from_bytes(text);
+        if capacity > text.len() {
+            s.reserve(capacity - text.len());
+        }
         self.strings.push(s);
 
-        let c_name = c_string(name)?;
-        let rv = unsafe {
-            symbol_table_add_stringvar(self.sym, c_name.as_ptr(), self.strings[i].0, false)
-        };
+        let rv = unsafe { symbol_table_add_stringvar(self.sym, n, l, self.strings[i].0, false) };
+
+        let res = self.validate_added(name, rv, i);
+        if res == Ok(Some(i)) {
+            self.string_names.push(name.to_string());
+            self.string_ids.insert(name_key(name).into_owned(), i);
+        } else {
+            self.strings.pop();
+        }
+        res
+    }
+
+    #[inline]
+    pub fn set_string(&mut self, var_id: usize, text: &str) -> bool {
+        if let Some(s) = self.strings.get_mut(var_id) {
+            s.set(text);
+            return true;
+        }
+        false
+    }
+
+    /// Returns a reference to a string variable given its ID.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the `var_id` refers to an invalid (too large)
+    /// variable ID.
+    #[inline]
+    pub fn string(&self, var_id: usize) -> &StringValue {
+        self.strings.get(var_id).expect("Invalid variable ID")
+    }
+
+    /// Returns a mutable reference to a string variable given its ID.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the `var_id` refers to an invalid (too large)
+    /// variable ID.
+    #[inline]
+    pub fn string_mut(&mut self, var_id: usize) -> &mut StringValue {
+        self.strings.get_mut(var_id).expect("Invalid variable ID")
+    }
+
+    /// Adds a new vector variable. Returns the variable ID that can later be used for `vector`
+    /// or `None` if a variable with the same name was already present.
+    pub fn add_vector(
+        &mut self,
+        name: &str,
+        vec: &[c_double],
+    ) -> Result<Option<usize>, InvalidName> {
+        let (n, nl) = c_name(name)?;
+        let i = self.vectors.len();
+        let l = vec.len();
+        self.vectors
+            .push(VectorData::Owned(vec.to_vec().into_boxed_slice()));
+
+        let rv = unsafe { symbol_table_add_vector(self.sym, n, nl, self.vectors[i].as_ptr(), l) };
+
+        let res = self.validate_added(name, rv, i);
+        if res == Ok(Some(i)) {
+            self.vector_names.push(name.to_string());
+            self.vector_ids.insert(name_key(name).into_owned(), i);
+        } else {
+            self.vectors.pop();
+        }
+        res
+    }
+
+    /// Adds a new vector variable, which directly refers to the memory of `vec`
+    /// instead of copying it (using an `exprtk::vector_view`). Returns the variable ID
+    /// or `None` if a variable with the same name was already present.
+    ///
+    /// Changes to the values of `vec` take effect in the next evaluation of
+    /// an expression using the vector, and vice versa. The vector can later be
+    /// pointed at another buffer using `rebind_vector`, without recompiling.
+    ///
+    /// # Safety
+    ///
+    /// The caller must ensure that the memory of `vec` stays valid for as long as the
+    /// symbol table (or any `Expression` owning it) is in use, or until the vector is
+    /// rebound to different memory. Clones of the symbol table refer to the same
+    /// buffer. No other references to the buffer should be alive while evaluating
+    /// an expression or accessing the vector through the symbol table.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut data = vec![1., 2., 3.];
+    /// let mut symbol_table = SymbolTable::new();
+    /// let v_id = unsafe { symbol_table.add_vector_view("v", &mut data) }.unwrap().unwrap();
+    /// let mut expr = Expression::new("v[0] + v[1] + v[2]", symbol_table).unwrap();
+    /// assert_eq!(expr.value(), 6.);
+    ///
+    /// let mut other = vec![4., 5., 6.];
+    /// unsafe { expr.symbols_mut().rebind_vector(v_id, &mut other) };
+    /// assert_eq!(expr.value(), 15.);
+    /// ```
+    pub unsafe fn add_vector_view(
+        &mut self,
+        name: &str,
+        vec: &mut [c_double],
+    ) -> Result<Option<usize>, InvalidName> {
+        let len = vec.len();
+        self.add_vector_view_raw(name, vec.as_mut_ptr(), len, len)
+    }
+
+    // Registers a view of size `base_len`, which is then reduced to `len`
+    unsafe fn add_vector_view_raw(
+        &mut self,
+        name: &str,
+        ptr: *mut c_double,
+        len: usize,
+        base_len: usize,
+    ) -> Result<Option<usize>, InvalidName> {
+        let (n, l) = c_name(name)?;
+        let i = self.vectors.len();
+        let view = vector_view_new(ptr, base_len as size_t);
+        if len != base_len {
+            assert!(vector_view_set_size(view, len as size_t));
+        }
+        self.vectors.push(VectorData::View {
+            view,
+            ptr,
+            len,
+            base_len,
+        });
+
+        let rv = symbol_table_add_vector_view(self.sym, n, l, view);
 
         let res = self.validate_added(name, rv, i);
-        if res.is_err() {
-            self.strings.pop();
+        if res == Ok(Some(i)) {
+            self.vector_names.push(name.to_string());
+            self.vector_ids.insert(name_key(name).into_owned(), i);
+        } else {
+            // the view is not used by the C++ symbol table
+            self.vectors.pop();
         }
         res
     }
 
-    #[inline]
-    pub fn set_string(&mut self, var_id: usize, text: &str) -> bool {
-        if let Some(s) = self.strings.get_mut(var_id) {
-            s.set(text);
-            return true;
-        }
-        false
-    }
-
-    /// Returns a reference to a string variable given its ID.
+    /// Points a vector added with `add_vector_view` to a new buffer. Compiled
+    /// expressions using the vector will access the new memory from the next
+    /// evaluation on. This is an O(1) operation.
+    ///
+    /// The new buffer may be shorter than the one initially registered, e.g. for
+    /// processing the last chunk of a larger dataset, but not longer. The size
+    /// operator (`v[]`) and vector operations will reflect the new length.
+    ///
+    /// # Safety
+    ///
+    /// The same requirements as for `add_vector_view` apply to the new buffer.
+    /// Additionally, if the buffer is shorter than the initial one, expressions
+    /// must not access elements at fixed positions beyond its end (e.g. `v[9]`),
+    /// since ExprTk only validates these at compile time.
     ///
     /// # Panics
     ///
     /// This function will panic if the `var_id` refers to an invalid (too large)
-    /// variable ID.
-    #[inline]
-    pub fn string(&self, var_id: usize) -> &StringValue {
-        self.strings.get(var_id).expect("Invalid variable ID")
+    /// variable ID, if the vector was not added with `add_vector_view`, or if
+    /// `vec` is empty or longer than the initially registered buffer
+    /// (see `vector_base_len`).
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let data: Vec<f64> = (1..=10).map(|i| i as f64).collect();
+    /// let mut chunk = vec![0.; 4];
+    /// let mut symbol_table = SymbolTable::new();
+    /// let v_id = unsafe { symbol_table.add_vector_view("v", &mut chunk) }.unwrap().unwrap();
+    /// let mut expr = Expression::new("sum(v)", symbol_table).unwrap();
+    ///
+    /// let mut sums = vec![];
+    /// for values in data.chunks(4) {
+    ///     chunk[..values.len()].copy_from_slice(values);
+    ///     unsafe { expr.symbols_mut().rebind_vector(v_id, &mut chunk[..values.len()]) };
+    ///     sums.push(expr.value());
+    /// }
+    /// assert_eq!(sums, vec![10., 26., 19.]);
+    /// ```
+    pub unsafe fn rebind_vector(&mut self, var_id: usize, vec: &mut [c_double]) {
+        let data = self.vectors.get_mut(var_id).expect("Invalid variable ID");
+        match *data {
+            VectorData::View {
+                view,
+                ref mut ptr,
+                ref mut len,
+                base_len,
+            } => {
+                assert!(
+                    !vec.is_empty() && vec.len() <= base_len,
+                    "Invalid vector length: {} (must be between 1 and {})",
+                    vec.len(),
+                    base_len
+                );
+                *ptr = vec.as_mut_ptr();
+                vector_view_rebase(view, *ptr);
+                if vec.len() != *len {
+                    *len = vec.len();
+                    // cannot fail after the above check
+                    vector_view_set_size(view, *len as size_t);
+                }
+            }
+            VectorData::Owned(_) => panic!("Vector was not added with add_vector_view"),
+        }
     }
 
-    /// Returns a mutable reference to a string variable given its ID.
+    /// Returns the maximum length of a vector that `rebind_vector` accepts (the
+    /// length at the time of adding it). For vectors not added with `add_vector_view`,
+    /// this is just the length of the vector.
     ///
     /// # Panics
     ///
     /// This function will panic if the `var_id` refers to an invalid (too large)
     /// variable ID.
-    #[inline]
-    pub fn string_mut(&mut self, var_id: usize) -> &mut StringValue {
-        self.strings.get_mut(var_id).expect("Invalid variable ID")
-    }
-
-    /// Adds a new vector variable. Returns the variable ID that can later be used for `vector`
-    /// or `None` if a variable with the same name was already present.
-    pub fn add_vector(
-        &mut self,
-        name: &str,
-        vec: &[c_double],
-    ) -> Result<Option<usize>, InvalidName> {
-        let i = self.vectors.len();
-        let l = vec.len();
-        self.vectors.push(vec.to_vec().into_boxed_slice());
-
-        let c_name = c_string(name)?;
-        let rv = unsafe {
-            symbol_table_add_vector(self.sym, c_name.as_ptr(), self.vectors[i].as_ptr(), l)
-        };
-
-        let res = self.validate_added(name, rv, i);
-        if res.is_err() {
-            self.vectors.pop();
+    pub fn vector_base_len(&self, var_id: usize) -> usize {
+        match *self.vectors.get(var_id).expect("Invalid variable ID") {
+            VectorData::Owned(ref v) => v.len(),
+            VectorData::View { base_len, .. } => base_len,
         }
-        res
     }
 
     /// Returns a reference to a vector given its variable ID.
@@ -487,7 +1891,10 @@ impl SymbolTable {
     /// variable ID.
     #[inline]
     pub fn vector(&self, var_id: usize) -> &[c_double] {
-        &**self.vectors.get(var_id).expect("Invalid variable ID")
+        self.vectors
+            .get(var_id)
+            .expect("Invalid variable ID")
+            .as_slice()
     }
 
     /// Returns an mutable reference to a vector given its variable ID.
@@ -498,7 +1905,10 @@ impl SymbolTable {
     /// variable ID.
     #[inline]
     pub fn vector_mut(&mut self, var_id: usize) -> &mut [c_double] {
-        &mut **self.vectors.get_mut(var_id).expect("Invalid variable ID")
+        self.vectors
+            .get_mut(var_id)
+            .expect("Invalid variable ID")
+            .as_mut_slice()
     }
 
     /// Returns a reference to a vector given its variable ID. The values are of the type
@@ -546,62 +1956,63 @@ impl SymbolTable {
         Ok(Some(out))
     }
 
-    fn get_var_ptr_from_name(&self, name: &str) -> Result<Option<*mut c_double>, InvalidName> {
-        let c_name = c_string(name)?;
-        let rv = unsafe { symbol_table_variable_ref(self.sym, c_name.as_ptr()) };
-        let rv = if rv.is_null() { None } else { Some(rv) };
-        Ok(rv)
+    #[inline]
+    fn lookup_id(ids: &HashMap<String, usize>, name: &str) -> Result<Option<usize>, InvalidName> {
+        c_name(name)?;
+        Ok(ids.get(name_key(name).as_ref()).cloned())
     }
 
     /// Returns the 'ID' of a variable or None if not found.
-    /// The function will return `Err(InvalidName)` if the name is not entirely
-    /// composed of ASCII characters.
+    /// The function will return `Err(InvalidName)` if the name contains
+    /// null bytes. The lookup is done on the Rust side without calling into C++.
+    #[inline]
     pub fn get_var_id(&self, name: &str) -> Result<Option<usize>, InvalidName> {
-        self.get_var_ptr_from_name(name)
-            .map(|opt_ptr| opt_ptr.and_then(|ptr| self.values.iter().position(|&p| p == ptr)))
+        Self::lookup_id(&self.var_ids, name)
     }
 
     /// Returns the 'ID' of a string or None if not found.
-    /// The function will return `Err(InvalidName)` if the name is not entirely
-    /// composed of ASCII characters.
+    /// The function will return `Err(InvalidName)` if the name contains
+    /// null bytes.
+    #[inline]
     pub fn get_string_id(&self, name: &str) -> Result<Option<usize>, InvalidName> {
-        let c_name = c_string(name)?;
-        let ptr = unsafe { symbol_table_stringvar_ref(self.sym, c_name.as_ptr()) };
-        let rv = if ptr.is_null() {
-            None
-        } else {
-            self.strings.iter().position(|s| s.0 == ptr)
-        };
-        Ok(rv)
+        Self::lookup_id(&self.string_ids, name)
     }
 
     /// Returns the 'ID' of a vector or None if not found.
-    /// The function will return `Err(InvalidName)` if the name is not entirely
-    /// composed of ASCII characters.
+    /// The function will return `Err(InvalidName)` if the name contains
+    /// null bytes.
+    #[inline]
     pub fn get_vec_id(&self, name: &str) -> Result<Option<usize>, InvalidName> {
-        let c_name = c_string(name)?;
-        let ptr = unsafe { symbol_table_vector_ptr(self.sym, c_name.as_ptr()) };
-        let rv = if ptr.is_null() {
-            None
-        } else {
-            self.vectors.iter().position(|v| v.as_ptr() == ptr)
-        };
-        Ok(rv)
+        Self::lookup_id(&self.vector_ids, name)
     }
 
+    /// Removes all variables and constants
     pub fn clear_variables(&mut self) {
+        self.var_block_len = 0;
+        // the records are kept, since bindings refer to them by index
+        for row in &mut self.rows {
+            row.fields.clear();
+        }
         self.values.clear();
+        self.var_names.clear();
+        self.var_ids.clear();
+        self.constants.clear();
         unsafe { symbol_table_clear_variables(self.sym) }
     }
 
     pub fn clear_strings(&mut self) {
         self.strings.clear();
+        self.string_names.clear();
+        self.string_ids.clear();
         unsafe { symbol_table_clear_strings(self.sym) }
     }
 
     pub fn clear_vectors(&mut self) {
-        self.vectors.clear();
+        // vector views must outlive their use by the C++ symbol table
         unsafe { symbol_table_clear_vectors(self.sym) }
+        self.vectors.clear();
+        self.vector_names.clear();
+        self.vector_ids.clear();
     }
 
     pub fn clear_local_constants(&mut self) {
@@ -628,142 +2039,246 @@ impl SymbolTable {
         unsafe { symbol_table_function_count(self.sym) as usize }
     }
 
+    /// Adds the constants `pi`, `epsilon` and `inf`
     pub fn add_constants(&mut self) -> bool {
-        unsafe { symbol_table_add_constants(self.sym) }
+        // same as symbol_table::add_constants()
+        self.add_pi() && self.add_epsilon() && self.add_infinity()
     }
 
     pub fn add_pi(&mut self) -> bool {
-        unsafe { symbol_table_add_pi(self.sym) }
+        let added = unsafe { symbol_table_add_pi(self.sym) };
+        self.add_builtin_constant("pi", added)
     }
 
     pub fn add_epsilon(&mut self) -> bool {
-        unsafe { symbol_table_add_epsilon(self.sym) }
+        let added = unsafe { symbol_table_add_epsilon(self.sym) };
+        self.add_builtin_constant("epsilon", added)
     }
 
     pub fn add_infinity(&mut self) -> bool {
-        unsafe { symbol_table_add_infinity(self.sym) }
+        let added = unsafe { symbol_table_add_infinity(self.sym) };
+        self.add_builtin_constant("inf", added)
     }
 
     pub fn get_variable_names(&self) -> Vec<String> {
+        let mut out = Vec::new();
         unsafe {
-            let l = symbol_table_get_variable_list(self.sym);
-            let out = (*l)
-                .get_slice()
-                .iter()
-                .map(|s| string_from_ptr!(*s))
-                .collect();
-            string_array_free(l);
-            out
+            symbol_table_get_variable_list(self.sym, push_name, &mut out as *mut _ as *mut c_void);
         }
+        out
     }
 
     pub fn get_stringvar_names(&self) -> Vec<String> {
+        let mut out = Vec::new();
         unsafe {
-            let l = symbol_table_get_stringvar_list(self.sym);
-            let out = (*l)
-                .get_slice()
-                .iter()
-                .map(|s| string_from_ptr!(*s))
-                .collect();
-            string_array_free(l);
-            out
+            symbol_table_get_stringvar_list(self.sym, push_name, &mut out as *mut _ as *mut c_void);
         }
+        out
     }
 
     pub fn get_vector_names(&self) -> Vec<String> {
+        let mut out = Vec::new();
         unsafe {
-            let l = symbol_table_get_vector_list(self.sym);
-            let out = (*l)
-                .get_slice()
+            symbol_table_get_vector_list(self.sym, push_name, &mut out as *mut _ as *mut c_void);
+        }
+        out
+    }
+
+    /// Returns a rough estimate of the number of bytes of memory used by the
+    /// symbol table. The Rust-side storage is counted exactly, the C++ symbol
+    /// table and its maps are estimated from the number of symbols. Vectors
+    /// added with `add_vector_view` are not included.
+    pub fn estimated_memory_usage(&self) -> usize {
+        let names = self
+            .var_names
+            .iter()
+            .chain(&self.string_names)
+            .chain(&self.vector_names)
+            .chain(self.constants.iter().map(|c| &c.0))
+            .chain(self.funcs.iter().map(|f| &f.name))
+            .chain(self.vec_funcs.iter().map(|f| &f.name))
+            .map(|n| n.capacity() + mem::size_of::<String>())
+            .sum::<usize>();
+        let id_maps = self
+            .var_ids
+            .keys()
+            .chain(self.string_ids.keys())
+            .chain(self.vector_ids.keys())
+            .map(|n| n.capacity() + mem::size_of::<(String, usize)>())
+            .sum::<usize>();
+        let n_symbols = self.values.len()
+            + self.strings.len()
+            + self.vectors.len()
+            + self.constants.len()
+            + self.funcs.len()
+            + self.vec_funcs.len();
+        let strings = self.strings.iter().map(|s| s.capacity()).sum::<usize>();
+        let vectors = self
+            .vectors
+            .iter()
+            .map(|v| match *v {
+                VectorData::Owned(ref v) => v.len() * mem::size_of::<c_double>(),
+                VectorData::View { .. } => 0,
+            })
+            .sum::<usize>();
+        mem::size_of::<SymbolTable>()
+            + SYMBOL_TABLE_BYTES
+            + names
+            + id_maps
+            + n_symbols * SYMBOL_BYTES
+            + self.values.capacity() * mem::size_of::<*mut c_double>()
+            + self.var_block.capacity() * mem::size_of::<CacheLine>()
+            + self
+                .rows
                 .iter()
-                .map(|s| string_from_ptr!(*s))
-                .collect();
-            string_array_free(l);
-            out
+                .map(|r| {
+                    mem::size_of::<RowData>()
+                        + r.buf.capacity() * mem::size_of::<CacheLine>()
+                        + r.fields.capacity() * mem::size_of::<(usize, usize)>()
+                })
+                .sum::<usize>()
+            + self.strings.capacity() * mem::size_of::<StringValue>()
+            + self.vectors.capacity() * mem::size_of::<VectorData>()
+            + self.funcs.capacity() * mem::size_of::<FuncData>()
+            + self.vec_funcs.capacity() * mem::size_of::<VecFuncData>()
+            + self.constants.capacity() * mem::size_of::<(String, c_double)>()
+            + strings
+            + vectors
+    }
+
+    /// Returns a description of all symbols (names, types and vector lengths)
+    /// in the order of their IDs, as well as the values of constants. Symbol
+    /// tables with the same signature have the same IDs for all symbols, and
+    /// compile formulas the same way.
+    pub(crate) fn signature(&self) -> String {
+        let mut out = String::new();
+        for &(ref n, v) in &self.constants {
+            out.push_str(&format!("c:{}={}\n", n, v.to_bits()));
+        }
+        for n in &self.var_names {
+            out.push_str(&format!("v:{}\n", n));
+        }
+        for n in &self.string_names {
+            out.push_str(&format!("s:{}\n", n));
+        }
+        for (n, v) in self.vector_names.iter().zip(&self.vectors) {
+            match *v {
+                VectorData::Owned(ref v) => out.push_str(&format!("V:{}:{}\n", n, v.len())),
+                VectorData::View { len, base_len, .. } => {
+                    out.push_str(&format!("W:{}:{}:{}\n", n, len, base_len))
+                }
+            }
+        }
+        for f in &self.funcs {
+            out.push_str(&format!("f:{}\n", f.name));
+        }
+        for f in &self.vec_funcs {
+            out.push_str(&format!("F:{}:{}\n", f.name, f.n_args));
+        }
+        out
+    }
+
+    /// Copies the values of variables, strings and vectors from a symbol table
+    /// with the same signature. Vector views are rebound to the buffers of `other`.
+    pub(crate) fn copy_values_from(&mut self, other: &SymbolTable) {
+        debug_assert_eq!(self.signature(), other.signature());
+        for var_id in 0..self.values.len() {
+            *self.value_mut(var_id) = other.value(var_id);
+        }
+        for (s, other_s) in self.strings.iter_mut().zip(&other.strings) {
+            s.set_bytes(other_s.get_bytes());
+        }
+        for var_id in 0..self.vectors.len() {
+            match other.vectors[var_id] {
+                VectorData::Owned(ref v) => self.vector_mut(var_id).copy_from_slice(v),
+                VectorData::View { ptr, len, .. } => unsafe {
+                    self.rebind_vector(var_id, slice::from_raw_parts_mut(ptr, len));
+                },
+            }
         }
     }
 
     pub fn symbol_exists(&self, name: &str) -> Result<bool, InvalidName> {
-        let c_name = c_string(name)?;
-        let rv = unsafe { symbol_table_symbol_exists(self.sym, c_name.as_ptr()) };
+        let (n, l) = c_name(name)?;
+        let rv = unsafe { symbol_table_symbol_exists(self.sym, n, l) };
         Ok(rv)
     }
 
     pub fn is_constant_node(&self, name: &str) -> Result<bool, InvalidName> {
-        let c_name = c_string(name)?;
-        let rv = unsafe { symbol_table_is_constant_node(self.sym, c_name.as_ptr()) };
+        let (n, l) = c_name(name)?;
+        let rv = unsafe { symbol_table_is_constant_node(self.sym, n, l) };
         Ok(rv)
     }
 
     pub fn is_constant_string(&self, name: &str) -> Result<bool, InvalidName> {
-        let c_name = c_string(name)?;
-        let rv = unsafe { symbol_table_is_constant_string(self.sym, c_name.as_ptr()) };
+        let (n, l) = c_name(name)?;
+        let rv = unsafe { symbol_table_is_constant_string(self.sym, n, l) };
         Ok(rv)
     }
 }
 
 macro_rules! func_impl {
-    ($name:ident, $n:expr, $sys_func:ident, $clone_func:ident, $free_closure:ident, $free_cpp_func:ident,
-        $($x:ident: $ty:ty),*) => {
+    ($name:ident, $name_opts:ident, $n:expr, $sys_func:ident, $clone_func:ident,
+        $free_closure:ident, $free_cpp_func:ident, $($x:ident: $ty:ty),*) => {
         impl SymbolTable {
-            /// Add a function with
+            /// Add a pure function with
             #[doc = $n]
             /// scalar arguments. Returns `true` if the function was added / `false`
             /// if the name was already present.
             pub fn $name<F>(&mut self, name: &str, func: F) -> Result<bool, InvalidName>
                 where F: Fn($($ty),*) -> c_double + Clone
+            {
+                self.$name_opts(name, FunctionOptions::default(), func)
+            }
+
+            /// Add a function with
+            #[doc = $n]
+            /// scalar arguments and the given options (see `FunctionOptions`).
+            pub fn $name_opts<F>(&mut self, name: &str, options: FunctionOptions, func: F)
+                -> Result<bool, InvalidName>
+                where F: Fn($($ty),*) -> c_double + Clone
             {
                 extern fn wrapper<F>(closure: *mut c_void, $($x: $ty),*) -> c_double
                     where F: Fn($($ty),*) -> c_double {
-                    unsafe {
-                        let opt_closure: Option<Box<F>> = mem::transmute(closure);
-                        opt_closure.map(|f| f($($x),*)).unwrap()
-                    }
+                    // the closure is only borrowed, it is freed by $free_closure
+                    let f = unsafe { &*(closure as *const F) };
+                    f($($x),*)
                 }
 
-                let func_box = Box::new(func);
-                let func_ptr = Box::into_raw(func_box) as *mut _ as *mut c_void;
-
-                let c_name = c_string(name)?;
+                let (n, l) = c_name(name)?;
+                let func_ptr = Box::into_raw(Box::new(func)) as *mut c_void;
                 let result = unsafe {
-                    $sys_func(self.sym, c_name.as_ptr(), wrapper::<F>, func_ptr)
+                    $sys_func(self.sym, n, l, options.has_side_effects, wrapper::<F>, func_ptr)
                 };
-
-                let is_new = self.validate_added(name, result.0, ())?.is_some();
-                if is_new {
-                    self.funcs.push(FuncData {
-                        name: name.to_string(),
-                        cpp_func: result.1,
-                        rust_closure: func_ptr,
-                        clone_func: $clone_func::<F>,
-                        free_cpp_func: $free_cpp_func,
-                        free_closure_func: $free_closure::<F>,
-                    });
-                }
-                Ok(is_new)
+                self.push_func(
+                    name,
+                    options,
+                    result,
+                    func_ptr,
+                    $clone_func::<F>,
+                    $free_cpp_func,
+                    $free_closure::<F>,
+                )
             }
         }
 
-        fn $clone_func<F>(name: &str, closure_ptr: *mut c_void, new_symbols: &mut SymbolTable)
-        -> Result<bool, InvalidName>
+        fn $clone_func<F>(name: &str, closure: *mut c_void, options: FunctionOptions,
+            new_symbols: &mut SymbolTable) -> Result<bool, InvalidName>
         where F: Fn($($ty),*) -> c_double + Clone
         {
-            let mut opt_closure: Option<Box<F>> = unsafe { mem::transmute(closure_ptr) };
-            let res = new_symbols.$name(name, *opt_closure.as_mut().unwrap().clone());
-            mem::forget(opt_closure); // prevent destruction
-            res
+            let f = unsafe { &*(closure as *const F) };
+            new_symbols.$name_opts(name, options, f.clone())
         }
 
-        fn $free_closure<F>(closure_ptr: *mut c_void)
-        where F: Fn($($ty),*) -> c_double + Clone
-        {
-            let _: Option<Box<F>> = unsafe { mem::transmute(closure_ptr) };
+        fn $free_closure<F>(closure: *mut c_void) {
+            drop(unsafe { Box::from_raw(closure as *mut F) });
         }
     }
 }
 
 func_impl!(
     add_func1,
+    add_func1_with_options,
     "1",
     symbol_table_add_func1,
     clone_func1,
@@ -773,6 +2288,7 @@ func_impl!(
 );
 func_impl!(
     add_func2,
+    add_func2_with_options,
     "2",
     symbol_table_add_func2,
     clone_func2,
@@ -783,6 +2299,7 @@ func_impl!(
 );
 func_impl!(
     add_func3,
+    add_func3_with_options,
     "3",
     symbol_table_add_func3,
     clone_func3,
@@ -794,6 +2311,7 @@ func_impl!(
 );
 func_impl!(
     add_func4,
+    add_func4_with_options,
     "4",
     symbol_table_add_func4,
     clone_func4,
@@ -806,6 +2324,7 @@ func_impl!(
 );
 func_impl!(
     add_func5,
+    add_func5_with_options,
     "5",
     symbol_table_add_func5,
     clone_func5,
@@ -819,6 +2338,7 @@ func_impl!(
 );
 func_impl!(
     add_func6,
+    add_func6_with_options,
     "6",
     symbol_table_add_func6,
     clone_func6,
@@ -833,6 +2353,7 @@ func_impl!(
 );
 func_impl!(
     add_func7,
+    add_func7_with_options,
     "7",
     symbol_table_add_func7,
     clone_func7,
@@ -848,6 +2369,7 @@ func_impl!(
 );
 func_impl!(
     add_func8,
+    add_func8_with_options,
     "8",
     symbol_table_add_func8,
     clone_func8,
@@ -864,6 +2386,7 @@ func_impl!(
 );
 func_impl!(
     add_func9,
+    add_func9_with_options,
     "9",
     symbol_table_add_func9,
     clone_func9,
@@ -881,6 +2404,7 @@ func_impl!(
 );
 func_impl!(
     add_func10,
+    add_func10_with_options,
     "10",
     symbol_table_add_func10,
     clone_func10,
@@ -904,6 +2428,344 @@ impl Default for exprtk::SymbolTable {
     }
 }
 
+impl SymbolTable {
+    /// Adds a function with `n_args` scalar arguments (at most 10), which can
+    /// process many values at once. The closure receives one slice per argument
+    /// and writes the results to `out`, all slices have the same length.
+    /// Returns `true` if the function was added / `false` if the name was
+    /// already present.
+    ///
+    /// When evaluated normally, the slices have a single element. With
+    /// `BlockEvaluator`, the function is called once per block of rows (with
+    /// a slice of values for each argument) if the formula can be vectorized.
+    /// The function must not have side effects, and the results must only
+    /// depend on the arguments.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if `n_args` is zero or larger than 10.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+    /// symbol_table.add_vec_func("sqdiff", 2, |args: &[&[f64]], out: &mut [f64]| {
+    ///     for ((o, &a), &b) in out.iter_mut().zip(args[0]).zip(args[1]) {
+    ///         *o = (a - b) * (a - b);
+    ///     }
+    /// }).unwrap();
+    ///
+    /// let expr = Expression::new("sqdiff(x, 1) + 1", symbol_table).unwrap();
+    /// let mut evaluator = BlockEvaluator::new(expr);
+    /// assert!(evaluator.is_vectorized());
+    ///
+    /// let x = [1., 2., 3.];
+    /// let mut out = [0.; 3];
+    /// evaluator.eval_batch(&[(x_id, &x)], &mut out);
+    /// assert_eq!(out, [1., 2., 5.]);
+    /// ```
+    pub fn add_vec_func<F>(
+        &mut self,
+        name: &str,
+        n_args: usize,
+        func: F,
+    ) -> Result<bool, InvalidName>
+    where
+        F: Fn(&[&[c_double]], &mut [c_double]) + Clone + 'static,
+    {
+        self.add_vec_func_boxed(name, n_args, Box::new(func))
+    }
+
+    fn add_vec_func_boxed(
+        &mut self,
+        name: &str,
+        n_args: usize,
+        func: Box<dyn VecFunc>,
+    ) -> Result<bool, InvalidName> {
+        assert!(
+            n_args > 0 && n_args <= MAX_VEC_FUNC_ARGS,
+            "Invalid number of arguments: {} (must be between 1 and {})",
+            n_args,
+            MAX_VEC_FUNC_ARGS
+        );
+
+        extern "C" fn wrapper(func: *mut c_void, args: *const c_double, n: size_t) -> c_double {
+            let func = unsafe { &*(func as *const Box<dyn VecFunc>) };
+            let args = unsafe { slice::from_raw_parts(args, n as usize) };
+            let mut columns: [&[c_double]; MAX_VEC_FUNC_ARGS] = [&[]; MAX_VEC_FUNC_ARGS];
+            for (c, a) in columns.iter_mut().zip(args) {
+                *c = slice::from_ref(a);
+            }
+            let mut out = 0.;
+            func.call(&columns[..args.len()], slice::from_mut(&mut out));
+            out
+        }
+
+        let (n, l) = c_name(name)?;
+        let func = Box::new(func);
+        let func_ptr = &*func as *const Box<dyn VecFunc> as *mut c_void;
+        let result = unsafe {
+            symbol_table_add_vec_func(self.sym, n, l, n_args as size_t, wrapper, func_ptr)
+        };
+        let is_new = self.validate_added(name, result.0, ())?.is_some();
+        if is_new {
+            self.vec_funcs.push(VecFuncData {
+                name: name.to_string(),
+                n_args,
+                cpp_func: result.1,
+                func,
+            });
+        }
+        Ok(is_new)
+    }
+
+    /// Returns the index and the number of arguments of a function added
+    /// with `add_vec_func`
+    pub(crate) fn vec_func_id(&self, name: &str) -> Option<(usize, usize)> {
+        let key = name_key(name);
+        self.vec_funcs
+            .iter()
+            .position(|f| name_key(&f.name) == key)
+            .map(|i| (i, self.vec_funcs[i].n_args))
+    }
+
+    /// Calls a function added with `add_vec_func` given its index
+    #[inline]
+    pub(crate) fn call_vec_func(&self, i: usize, args: &[&[c_double]], out: &mut [c_double]) {
+        self.vec_funcs[i].func.call(args, out)
+    }
+}
+
+impl SymbolTable {
+    /// Adds a function taking any number of scalar arguments, which are passed
+    /// to the closure as a slice. Returns `true` if the function was added /
+    /// `false` if the name was already present.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// symbol_table.add_vararg_func("mean", |args| {
+    ///     args.iter().sum::<f64>() / args.len() as f64
+    /// }).unwrap();
+    ///
+    /// let mut expr = Expression::new("mean(1, 2, 3, 4, 5, 6)", symbol_table).unwrap();
+    /// assert_eq!(expr.value(), 3.5);
+    /// ```
+    pub fn add_vararg_func<F>(&mut self, name: &str, func: F) -> Result<bool, InvalidName>
+    where
+        F: Fn(&[c_double]) -> c_double + Clone,
+    {
+        self.add_vararg_func_with_options(name, FunctionOptions::default(), func)
+    }
+
+    /// Adds a variadic function with the given options (see `FunctionOptions`)
+    pub fn add_vararg_func_with_options<F>(
+        &mut self,
+        name: &str,
+        options: FunctionOptions,
+        func: F,
+    ) -> Result<bool, InvalidName>
+    where
+        F: Fn(&[c_double]) -> c_double + Clone,
+    {
+        extern "C" fn wrapper<F>(closure: *mut c_void, args: *const c_double, n: size_t) -> c_double
+        where
+            F: Fn(&[c_double]) -> c_double,
+        {
+            let f = unsafe { &*(closure as *const F) };
+            if n == 0 {
+                return f(&[]);
+            }
+            f(unsafe { slice::from_raw_parts(args, n as usize) })
+        }
+
+        fn clone_func<F>(
+            name: &str,
+            closure: *mut c_void,
+            options: FunctionOptions,
+            new_symbols: &mut SymbolTable,
+        ) -> Result<bool, InvalidName>
+        where
+            F: Fn(&[c_double]) -> c_double + Clone,
+        {
+            let f = unsafe { &*(closure as *const F) };
+            new_symbols.add_vararg_func_with_options(name, options, f.clone())
+        }
+
+        fn free_closure<F>(closure: *mut c_void) {
+            drop(unsafe { Box::from_raw(closure as *mut F) });
+        }
+
+        let (n, l) = c_name(name)?;
+        let func_ptr = Box::into_raw(Box::new(func)) as *mut c_void;
+        let result = unsafe {
+            symbol_table_add_vararg_func(
+                self.sym,
+                n,
+                l,
+                options.has_side_effects,
+                wrapper::<F>,
+                func_ptr,
+            )
+        };
+        self.push_func(
+            name,
+            options,
+            result,
+            func_ptr,
+            clone_func::<F>,
+            symbol_table_free_vararg_func,
+            free_closure::<F>,
+        )
+    }
+
+    /// Adds a function with scalar, vector and/or string arguments, which are
+    /// passed to the closure as `GenericArg` referring to the data owned by
+    /// ExprTk. `param_seq` describes the allowed arguments as in ExprTk,
+    /// e.g. `"TV"` for a scalar followed by a vector, `"S|VV"` for a string or
+    /// two vectors, `"T*"` for any number of scalars, or `""` for any arguments
+    /// (see the
+    /// [ExprTk documentation](https://github.com/ArashPartow/exprtk/blob/f32d2b4bbb640ea4732b8a7fce1bd9717e9c998b/readme.txt#L3598)).
+    /// Returns `true` if the function was added / `false` if the name was
+    /// already present.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut symbol_table = SymbolTable::new();
+    /// symbol_table.add_vector("v", &[1., 2., 3.]).unwrap();
+    /// symbol_table.add_generic_func("dot", "VV", |args| {
+    ///     let a = args[0].vector().unwrap();
+    ///     let b = args[1].vector().unwrap();
+    ///     a.iter().zip(b).map(|(x, y)| x * y).sum()
+    /// }).unwrap();
+    ///
+    /// let mut expr = Expression::new("dot(v, v)", symbol_table).unwrap();
+    /// assert_eq!(expr.value(), 14.);
+    /// ```
+    pub fn add_generic_func<F>(
+        &mut self,
+        name: &str,
+        param_seq: &str,
+        func: F,
+    ) -> Result<bool, InvalidName>
+    where
+        F: Fn(&[GenericArg]) -> c_double + Clone,
+    {
+        self.add_generic_func_with_options(name, param_seq, FunctionOptions::default(), func)
+    }
+
+    /// Adds a generic function with the given options (see `FunctionOptions`)
+    pub fn add_generic_func_with_options<F>(
+        &mut self,
+        name: &str,
+        param_seq: &str,
+        options: FunctionOptions,
+        func: F,
+    ) -> Result<bool, InvalidName>
+    where
+        F: Fn(&[GenericArg]) -> c_double + Clone,
+    {
+        // the parameter sequence is stored along with the closure for cloning
+        extern "C" fn wrapper<F>(
+            closure: *mut c_void,
+            args: *const CGenericArg,
+            n: size_t,
+        ) -> c_double
+        where
+            F: Fn(&[GenericArg]) -> c_double,
+        {
+            let f = unsafe { &(*(closure as *const (String, F))).1 };
+            if n == 0 {
+                return f(&[]);
+            }
+            f(unsafe { slice::from_raw_parts(args as *const GenericArg, n as usize) })
+        }
+
+        fn clone_func<F>(
+            name: &str,
+            closure: *mut c_void,
+            options: FunctionOptions,
+            new_symbols: &mut SymbolTable,
+        ) -> Result<bool, InvalidName>
+        where
+            F: Fn(&[GenericArg]) -> c_double + Clone,
+        {
+            let data = unsafe { &*(closure as *const (String, F)) };
+            new_symbols.add_generic_func_with_options(name, &data.0, options, data.1.clone())
+        }
+
+        fn free_closure<F>(closure: *mut c_void) {
+            drop(unsafe { Box::from_raw(closure as *mut (String, F)) });
+        }
+
+        let (n, l) = c_name(name)?;
+        let (p, pl) = c_name(param_seq)?;
+        let func_ptr = Box::into_raw(Box::new((param_seq.to_string(), func))) as *mut c_void;
+        let result = unsafe {
+            symbol_table_add_generic_func(
+                self.sym,
+                n,
+                l,
+                p,
+                pl,
+                options.has_side_effects,
+                wrapper::<F>,
+                func_ptr,
+            )
+        };
+        self.push_func(
+            name,
+            options,
+            result,
+            func_ptr,
+            clone_func::<F>,
+            symbol_table_free_generic_func,
+            free_closure::<F>,
+        )
+    }
+
+    /// Registers a function added to the C++ symbol table, or frees it if
+    /// the name was already present.
+    fn push_func(
+        &mut self,
+        name: &str,
+        options: FunctionOptions,
+        result: Pair<bool, *mut c_void>,
+        closure: *mut c_void,
+        clone_func: CloneFunc,
+        free_cpp_func: unsafe extern "C" fn(*mut c_void),
+        free_closure_func: fn(*mut c_void),
+    ) -> Result<bool, InvalidName> {
+        let is_new = match self.validate_added(name, result.0, ()) {
+            Ok(r) => r.is_some(),
+            Err(e) => {
+                free_closure_func(closure);
+                return Err(e);
+            }
+        };
+        if is_new {
+            self.funcs.push(FuncData {
+                name: name.to_string(),
+                options,
+                cpp_func: result.1,
+                rust_closure: closure,
+                clone_func,
+                free_cpp_func,
+                free_closure_func,
+            });
+        } else {
+            free_closure_func(closure);
+        }
+        Ok(is_new)
+    }
+}
+
 impl Drop for SymbolTable {
     fn drop(&mut self) {
         // strings have their owne destructor, but function pointers need to be freed
@@ -939,7 +2801,7 @@ impl fmt::Debug for SymbolTable {
             format!("[{}]", self.get_stringvar_names()
                 .iter()
                 .map(|n| format!("\"{}\": \"{}\"", n,
-                    self.string(self.get_string_id(n).unwrap().unwrap()).get())
+                    String::from_utf8_lossy(self.string(self.get_string_id(n).unwrap().unwrap()).get_bytes()))
                 )
                 .collect::<Vec<_>>()
                 .join(", ")
@@ -952,7 +2814,9 @@ impl fmt::Debug for SymbolTable {
             ),
             format!("[{}]", self.funcs
                 .iter()
-                .map(|f| f.name.to_string())
+                .map(|f| &f.name)
+                .chain(self.vec_funcs.iter().map(|f| &f.name))
+                .map(|n| n.to_string())
                 .collect::<Vec<_>>()
                 .join(", ")
             ),
@@ -961,30 +2825,66 @@ impl fmt::Debug for SymbolTable {
 }
 
 impl Clone for SymbolTable {
+    /// Creates a new symbol table with copies of all symbols (except for vectors
+    /// added with `add_vector_view`, which refer to the same buffer).
+    /// The symbols are added in the order of their IDs, so the IDs remain valid
+    /// for the clone.
     fn clone(&self) -> SymbolTable {
-        let mut s = Self::new();
+        let mut s = Self::with_variable_block(&self.var_names[..self.var_block_len]).unwrap();
+        s.variable_block_mut()
+            .copy_from_slice(self.variable_block());
         // vars
-        for n in self.get_variable_names() {
-            let v = self.value_from_name(&n).unwrap();
-            if self.is_constant_node(&n).unwrap() {
-                s.add_constant(&n, v).unwrap();
+        for &(ref n, v) in &self.constants {
+            s.add_constant(n, v).unwrap();
+        }
+        // records (see `bind_row`), the fields are bound below
+        let mut row_fields = HashMap::new();
+        for (i, row) in self.rows.iter().enumerate() {
+            s.rows.push(RowData {
+                buf: row.buf.clone(),
+                type_id: row.type_id,
+                fields: Vec::with_capacity(row.fields.len()),
+            });
+            for &(var_id, offset) in &row.fields {
+                row_fields.insert(var_id, (i, offset));
+            }
+        }
+        for (var_id, n) in self.var_names.iter().enumerate().skip(self.var_block_len) {
+            if let Some(&(row, offset)) = row_fields.get(&var_id) {
+                unsafe {
+                    let ptr = s.rows[row].ptr().add(offset) as *mut c_double;
+                    s.add_external_variable(n, ptr).unwrap();
+                }
+                s.rows[row].fields.push((var_id, offset));
             } else {
-                s.add_variable(&n, v).unwrap();
+                s.add_variable(n, self.value(var_id)).unwrap();
             }
         }
         // strings
-        for n in self.get_stringvar_names() {
-            let v = self.string(self.get_string_id(&n).unwrap().unwrap()).get();
-            s.add_stringvar(&n, &v).unwrap();
+        for (n, v) in self.string_names.iter().zip(&self.strings) {
+            s.add_stringvar_bytes(n, v.get_bytes(), v.capacity())
+                .unwrap();
         }
         // vectors
-        for n in self.get_vector_names() {
-            let v = self.vector(self.get_vec_id(&n).unwrap().unwrap());
-            s.add_vector(&n, v).unwrap();
+        for (n, v) in self.vector_names.iter().zip(&self.vectors) {
+            match *v {
+                VectorData::Owned(ref v) => {
+                    s.add_vector(n, v).unwrap();
+                }
+                VectorData::View {
+                    ptr, len, base_len, ..
+                } => unsafe {
+                    s.add_vector_view_raw(n, ptr, len, base_len).unwrap();
+                },
+            }
         }
         // functions
         for f in &self.funcs {
-            (f.clone_func)(&f.name, f.rust_closure, &mut s).unwrap();
+            (f.clone_func)(&f.name, f.rust_closure, f.options, &mut s).unwrap();
+        }
+        for f in &self.vec_funcs {
+            s.add_vec_func_boxed(&f.name, f.n_args, f.func.box_clone())
+                .unwrap();
         }
         s
     }
@@ -995,16 +2895,29 @@ pub struct StringValue(*mut CppString);
 
 impl StringValue {
     pub fn new(value: &str) -> StringValue {
+        Self::from_bytes(value.as_bytes())
+    }
+
+    fn from_bytes(value: &[u8]) -> StringValue {
         let s =
             unsafe { cpp_string_create(value.as_ptr() as *const c_char, value.len() as size_t) };
         StringValue(s)
     }
 
-    /// Assigns a new value to the string.
+    /// Assigns a new value to the string. No memory is allocated if the value
+    /// is not longer than the capacity (see `reserve`).
     /// *Note* that setting non-ASCII values will not necessarily fail, but may result in
     /// wrong results. The length of a string (`'string[]'`) will not be correct if containing
     /// multi-byte UTF-8 characters.
+    #[inline]
     pub fn set(&mut self, value: &str) {
+        self.set_bytes(value.as_bytes())
+    }
+
+    /// Assigns a new value to the string like `set`, but the value does not
+    /// need to be valid UTF-8.
+    #[inline]
+    pub fn set_bytes(&mut self, value: &[u8]) {
         unsafe {
             cpp_string_set(
                 self.0,
@@ -1015,10 +2928,39 @@ impl StringValue {
     }
 
     /// Returns a reference to the internal string.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the string is not valid UTF-8, which can
+    /// happen with `set_bytes` or with substrings of multi-byte
+    /// characters (use `get_bytes` instead).
+    #[inline]
     pub fn get(&self) -> &str {
-        unsafe { CStr::from_ptr(cpp_string_get(self.0)) }
-            .to_str()
-            .unwrap()
+        str::from_utf8(self.get_bytes()).expect("String is not valid UTF-8")
+    }
+
+    /// Returns a reference to the internal string without UTF-8 validation.
+    #[inline]
+    pub fn get_bytes(&self) -> &[u8] {
+        unsafe {
+            let v = cpp_string_data(self.0);
+            if v.len == 0 {
+                return &[];
+            }
+            slice::from_raw_parts(v.data as *const u8, v.len as usize)
+        }
+    }
+
+    /// Reserves capacity for at least `additional` more bytes than the current
+    /// length, so that setting values up to this length does not allocate.
+    pub fn reserve(&mut self, additional: usize) {
+        let len = self.get_bytes().len();
+        unsafe { cpp_string_reserve(self.0, (len + additional) as size_t) }
+    }
+
+    /// Returns the number of bytes the string can hold without allocating.
+    pub fn capacity(&self) -> usize {
+        unsafe { cpp_string_capacity(self.0) as usize }
     }
 }
 
@@ -1030,6 +2972,10 @@ impl Drop for StringValue {
 
 impl fmt::Debug for StringValue {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        write!(f, "StringValue {{ {} }}", self.get())
+        write!(
+            f,
+            "StringValue {{ {} }}",
+            String::from_utf8_lossy(self.get_bytes())
+        )
     }
 }
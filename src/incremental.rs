@@ -0,0 +1,239 @@
+//! Incremental evaluation of simple formulas, recomputing only the parts that
+//! depend on changed variables
+
+use std::slice;
+
+use libc::c_double;
+
+use super::exprtk::MAX_VEC_FUNC_ARGS;
+use super::ir::{self, BinaryOp, Node, UnaryOp};
+use super::*;
+
+/// Evaluates an expression incrementally: the results of all subexpressions are
+/// kept, and on the next call to `value`, only those depending on variables
+/// whose value changed in the meantime are recomputed.
+///
+/// Changes are detected by comparing the variables with their values at the
+/// last evaluation, so it does not matter whether they were modified with
+/// `SymbolTable::value_mut`, `value_cell` or by other means. This costs one
+/// comparison per variable used by the formula, which pays off for large
+/// formulas where only few inputs change between evaluations.
+///
+/// The same subset of formulas as with `BlockEvaluator` is supported (see
+/// `is_incremental`). Any other formula, which may contain loops, assignments
+/// or functions with side effects, is evaluated by ExprTk every time. As with
+/// `BlockEvaluator`, the results can differ from ExprTk in the last bits.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 1.).unwrap().unwrap();
+/// symbol_table.add_variable("y", 2.).unwrap();
+/// let expr = Expression::new("sqrt(y^2 + 12) * 2 + x", symbol_table).unwrap();
+/// let mut evaluator = IncrementalExpression::new(expr);
+/// assert!(evaluator.is_incremental());
+/// assert_eq!(evaluator.value(), 9.);
+///
+/// // only the addition of `x` is recomputed
+/// *evaluator.expression_mut().symbols_mut().value_mut(x_id) = 2.;
+/// assert_eq!(evaluator.value(), 10.);
+/// ```
+pub struct IncrementalExpression {
+    expr: Expression,
+    graph: Option<Graph>,
+}
+
+impl IncrementalExpression {
+    pub fn new(expr: Expression) -> IncrementalExpression {
+        let graph = ir::parse(expr.formula(), expr.symbols()).map(|n| Graph::new(&n));
+        IncrementalExpression { expr, graph }
+    }
+
+    /// Returns `true` if the formula is evaluated incrementally, or `false` if
+    /// it is evaluated by ExprTk.
+    pub fn is_incremental(&self) -> bool {
+        self.graph.is_some()
+    }
+
+    /// Returns a reference to the expression
+    pub fn expression(&self) -> &Expression {
+        &self.expr
+    }
+
+    /// Returns a mutable reference to the expression, e.g. for changing the
+    /// values of variables.
+    pub fn expression_mut(&mut self) -> &mut Expression {
+        &mut self.expr
+    }
+
+    /// Returns the expression
+    pub fn into_inner(self) -> Expression {
+        self.expr
+    }
+
+    /// Calculates the value of the expression, reusing the results of all
+    /// subexpressions whose variables did not change since the last call.
+    pub fn value(&mut self) -> c_double {
+        match self.graph {
+            Some(ref mut g) => g.eval(self.expr.symbols()),
+            None => self.expr.value(),
+        }
+    }
+}
+
+#[derive(Clone, Debug)]
+enum Op {
+    Const(c_double),
+    /// Variable at the given index of `Graph::vars`
+    Var(usize),
+    Unary(UnaryOp, usize),
+    Binary(BinaryOp, usize, usize),
+    /// Function added with `add_vec_func` (index, arguments)
+    Call(usize, Vec<usize>),
+}
+
+/// Nodes of the formula in post-order, i.e. every node comes after its operands
+struct Graph {
+    ops: Vec<Op>,
+    // index of the parent node (the root is its own parent)
+    parents: Vec<usize>,
+    // cached results of all nodes
+    values: Vec<c_double>,
+    dirty: Vec<bool>,
+    // nodes to recompute in the next evaluation
+    pending: Vec<usize>,
+    // variable IDs, with the values (bits) of the last evaluation and the
+    // nodes loading them
+    vars: Vec<usize>,
+    inputs: Vec<u64>,
+    var_nodes: Vec<Vec<usize>>,
+    evaluated: bool,
+}
+
+impl Graph {
+    fn new(node: &Node) -> Graph {
+        let mut g = Graph {
+            ops: vec![],
+            parents: vec![],
+            values: vec![],
+            dirty: vec![],
+            pending: vec![],
+            vars: vec![],
+            inputs: vec![],
+            var_nodes: vec![],
+            evaluated: false,
+        };
+        let root = g.add(node);
+        g.parents[root] = root;
+        g.values = vec![0.; g.ops.len()];
+        g.dirty = vec![false; g.ops.len()];
+        g.inputs = vec![0; g.vars.len()];
+        g
+    }
+
+    fn add(&mut self, node: &Node) -> usize {
+        let op = match *node {
+            Node::Const(v) => Op::Const(v),
+            Node::Var(var_id) => {
+                let slot = match self.vars.iter().position(|&v| v == var_id) {
+                    Some(slot) => slot,
+                    None => {
+                        self.vars.push(var_id);
+                        self.var_nodes.push(vec![]);
+                        self.vars.len() - 1
+                    }
+                };
+                self.var_nodes[slot].push(self.ops.len());
+                Op::Var(slot)
+            }
+            Node::Unary(op, ref a) => Op::Unary(op, self.add(a)),
+            Node::Binary(op, ref a, ref b) => {
+                let a = self.add(a);
+                Op::Binary(op, a, self.add(b))
+            }
+            Node::Call(func, ref args) => {
+                Op::Call(func, args.iter().map(|a| self.add(a)).collect())
+            }
+        };
+        let i = self.ops.len();
+        match op {
+            Op::Const(_) | Op::Var(_) => {}
+            Op::Unary(_, a) => self.parents[a] = i,
+            Op::Binary(_, a, b) => {
+                self.parents[a] = i;
+                self.parents[b] = i;
+            }
+            Op::Call(_, ref args) => {
+                for &a in args {
+                    self.parents[a] = i;
+                }
+            }
+        }
+        self.ops.push(op);
+        self.parents.push(i);
+        i
+    }
+
+    fn eval(&mut self, symbols: &SymbolTable) -> c_double {
+        if !self.evaluated {
+            for (slot, &var_id) in self.vars.iter().enumerate() {
+                self.inputs[slot] = symbols.value(var_id).to_bits();
+            }
+            for i in 0..self.ops.len() {
+                self.values[i] = self.compute(i, symbols);
+            }
+            self.evaluated = true;
+            return self.values[self.ops.len() - 1];
+        }
+
+        // mark the paths from changed variables to the root
+        for (slot, &var_id) in self.vars.iter().enumerate() {
+            let bits = symbols.value(var_id).to_bits();
+            if bits == self.inputs[slot] {
+                continue;
+            }
+            self.inputs[slot] = bits;
+            for &node in &self.var_nodes[slot] {
+                let mut i = node;
+                while !self.dirty[i] {
+                    self.dirty[i] = true;
+                    self.pending.push(i);
+                    i = self.parents[i];
+                }
+            }
+        }
+        if !self.pending.is_empty() {
+            // operands have lower indices than the nodes using them
+            self.pending.sort_unstable();
+            for j in 0..self.pending.len() {
+                let i = self.pending[j];
+                self.values[i] = self.compute(i, symbols);
+                self.dirty[i] = false;
+            }
+            self.pending.clear();
+        }
+        self.values[self.ops.len() - 1]
+    }
+
+    #[inline]
+    fn compute(&self, i: usize, symbols: &SymbolTable) -> c_double {
+        let v = &self.values;
+        match self.ops[i] {
+            Op::Const(c) => c,
+            Op::Var(slot) => c_double::from_bits(self.inputs[slot]),
+            Op::Unary(op, a) => op.apply(v[a]),
+            Op::Binary(op, a, b) => op.apply(v[a], v[b]),
+            Op::Call(func, ref args) => {
+                let mut arg_slices: [&[c_double]; MAX_VEC_FUNC_ARGS] = [&[]; MAX_VEC_FUNC_ARGS];
+                for (s, &a) in arg_slices.iter_mut().zip(args) {
+                    *s = slice::from_ref(&v[a]);
+                }
+                let mut out = [0.];
+                symbols.call_vec_func(func, &arg_slices[..args.len()], &mut out);
+                out[0]
+            }
+        }
+    }
+}
@@ -0,0 +1,365 @@
+//! Rust-side representation of simple formulas, which allows evaluating them
+//! without walking the ExprTk node tree.
+//!
+//! ExprTk does not expose its compiled tree, therefore the formula of an
+//! `Expression` is parsed again. Only a subset of the ExprTk syntax is supported:
+//! numbers, variables and constants of the symbol table, the operators
+//! `+ - * / % ^`, some builtin functions and functions added with
+//! `SymbolTable::add_vec_func`. Anything else (branches, assignments, strings,
+//! vectors, other user-defined functions, etc.) makes `parse()`
+//! return `None`, and the formula has to be evaluated by ExprTk. The same is done
+//! for constructs whose precedence could differ from ExprTk, such as `-x^2`.
+
+use libc::c_double;
+
+use super::exprtk::name_key;
+use super::*;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub(crate) enum UnaryOp {
+    Neg,
+    Abs,
+    Sqrt,
+    Exp,
+    Log,
+    Log10,
+    Sin,
+    Cos,
+    Tan,
+    Floor,
+    Ceil,
+}
+
+impl UnaryOp {
+    fn from_name(name: &str) -> Option<UnaryOp> {
+        let op = match name {
+            "abs" => UnaryOp::Abs,
+            "sqrt" => UnaryOp::Sqrt,
+            "exp" => UnaryOp::Exp,
+            "log" => UnaryOp::Log,
+            "log10" => UnaryOp::Log10,
+            "sin" => UnaryOp::Sin,
+            "cos" => UnaryOp::Cos,
+            "tan" => UnaryOp::Tan,
+            "floor" => UnaryOp::Floor,
+            "ceil" => UnaryOp::Ceil,
+            _ => return None,
+        };
+        Some(op)
+    }
+
+    #[inline]
+    pub(crate) fn apply(self, x: c_double) -> c_double {
+        match self {
+            UnaryOp::Neg => -x,
+            UnaryOp::Abs => x.abs(),
+            UnaryOp::Sqrt => x.sqrt(),
+            UnaryOp::Exp => x.exp(),
+            UnaryOp::Log => x.ln(),
+            UnaryOp::Log10 => x.log10(),
+            UnaryOp::Sin => x.sin(),
+            UnaryOp::Cos => x.cos(),
+            UnaryOp::Tan => x.tan(),
+            UnaryOp::Floor => x.floor(),
+            UnaryOp::Ceil => x.ceil(),
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub(crate) enum BinaryOp {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Rem,
+    Pow,
+    Min,
+    Max,
+}
+
+impl BinaryOp {
+    #[inline]
+    pub(crate) fn apply(self, a: c_double, b: c_double) -> c_double {
+        match self {
+            BinaryOp::Add => a + b,
+            BinaryOp::Sub => a - b,
+            BinaryOp::Mul => a * b,
+            BinaryOp::Div => a / b,
+            // same as std::fmod
+            BinaryOp::Rem => a % b,
+            BinaryOp::Pow => a.powf(b),
+            // same as std::min / std::max (also regarding NaN)
+            BinaryOp::Min => {
+                if b < a {
+                    b
+                } else {
+                    a
+                }
+            }
+            BinaryOp::Max => {
+                if a < b {
+                    b
+                } else {
+                    a
+                }
+            }
+        }
+    }
+}
+
+/// Node of a formula. Variables are referred to by their ID in the symbol table,
+/// constants are replaced by their value.
+#[derive(Clone, Debug, PartialEq)]
+pub(crate) enum Node {
+    Const(c_double),
+    Var(usize),
+    Unary(UnaryOp, Box<Node>),
+    Binary(BinaryOp, Box<Node>, Box<Node>),
+    /// Call of a function added with `add_vec_func` (given its index)
+    Call(usize, Vec<Node>),
+}
+
+impl Node {
+    /// Returns `true` if the node contains calls to user-defined functions
+    #[cfg(feature = "jit")]
+    pub(crate) fn has_calls(&self) -> bool {
+        match *self {
+            Node::Const(_) | Node::Var(_) => false,
+            Node::Unary(_, ref a) => a.has_calls(),
+            Node::Binary(_, ref a, ref b) => a.has_calls() || b.has_calls(),
+            Node::Call(..) => true,
+        }
+    }
+
+    fn unary(op: UnaryOp, a: Node) -> Node {
+        match a {
+            Node::Const(a) => Node::Const(op.apply(a)),
+            a => Node::Unary(op, Box::new(a)),
+        }
+    }
+
+    fn binary(op: BinaryOp, a: Node, b: Node) -> Node {
+        match (a, b) {
+            (Node::Const(a), Node::Const(b)) => Node::Const(op.apply(a, b)),
+            (a, b) => Node::Binary(op, Box::new(a), Box::new(b)),
+        }
+    }
+}
+
+/// Parses the formula of an expression, returns `None` if it uses
+/// unsupported syntax.
+pub(crate) fn parse(formula: &str, symbols: &SymbolTable) -> Option<Node> {
+    let tokens = tokenize(formula)?;
+    let mut parser = FormulaParser {
+        tokens,
+        pos: 0,
+        symbols,
+    };
+    let node = parser.expr()?;
+    if parser.pos == parser.tokens.len() {
+        Some(node)
+    } else {
+        None
+    }
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum Token<'a> {
+    Num(c_double),
+    Ident(&'a str),
+    Op(u8),
+    LParen,
+    RParen,
+    Comma,
+}
+
+fn tokenize<'a>(s: &'a str) -> Option<Vec<Token<'a>>> {
+    let bytes = s.as_bytes();
+    let mut tokens = vec![];
+    let mut i = 0;
+    while i < bytes.len() {
+        let c = bytes[i];
+        let start = i;
+        i += 1;
+        let token = match c {
+            b' ' | b'\t' | b'\r' | b'\n' => continue,
+            b'+' | b'-' | b'*' | b'/' | b'%' | b'^' => Token::Op(c),
+            b'(' => Token::LParen,
+            b')' => Token::RParen,
+            b',' => Token::Comma,
+            b'0'..=b'9' | b'.' => {
+                while i < bytes.len() && (bytes[i].is_ascii_digit() || bytes[i] == b'.') {
+                    i += 1;
+                }
+                if i < bytes.len() && (bytes[i] == b'e' || bytes[i] == b'E') {
+                    i += 1;
+                    if i < bytes.len() && (bytes[i] == b'+' || bytes[i] == b'-') {
+                        i += 1;
+                    }
+                    while i < bytes.len() && bytes[i].is_ascii_digit() {
+                        i += 1;
+                    }
+                }
+                Token::Num(s[start..i].parse().ok()?)
+            }
+            c if c.is_ascii_alphabetic() || c == b'_' => {
+                while i < bytes.len() && (bytes[i].is_ascii_alphanumeric() || bytes[i] == b'_') {
+                    i += 1;
+                }
+                Token::Ident(&s[start..i])
+            }
+            _ => return None,
+        };
+        tokens.push(token);
+    }
+    Some(tokens)
+}
+
+struct FormulaParser<'a, 's> {
+    tokens: Vec<Token<'a>>,
+    pos: usize,
+    symbols: &'s SymbolTable,
+}
+
+impl<'a, 's> FormulaParser<'a, 's> {
+    fn peek(&self) -> Option<Token<'a>> {
+        self.tokens.get(self.pos).cloned()
+    }
+
+    fn next(&mut self) -> Option<Token<'a>> {
+        let t = self.peek();
+        self.pos += 1;
+        t
+    }
+
+    fn expect(&mut self, token: Token) -> Option<()> {
+        if self.next()? == token {
+            Some(())
+        } else {
+            None
+        }
+    }
+
+    // expr := term (('+' | '-') term)*
+    fn expr(&mut self) -> Option<Node> {
+        let mut node = self.term()?;
+        loop {
+            let op = match self.peek() {
+                Some(Token::Op(b'+')) => BinaryOp::Add,
+                Some(Token::Op(b'-')) => BinaryOp::Sub,
+                _ => return Some(node),
+            };
+            self.pos += 1;
+            node = Node::binary(op, node, self.term()?);
+        }
+    }
+
+    // term := factor (('*' | '/' | '%') factor)*
+    fn term(&mut self) -> Option<Node> {
+        let mut node = self.factor()?;
+        loop {
+            let op = match self.peek() {
+                Some(Token::Op(b'*')) => BinaryOp::Mul,
+                Some(Token::Op(b'/')) => BinaryOp::Div,
+                Some(Token::Op(b'%')) => BinaryOp::Rem,
+                _ => return Some(node),
+            };
+            self.pos += 1;
+            node = Node::binary(op, node, self.factor()?);
+        }
+    }
+
+    // factor := unary ('^' unary)?
+    // A signed base (-x^2) or chained powers (x^y^z) are not accepted
+    fn factor(&mut self) -> Option<Node> {
+        let signed = match self.peek() {
+            Some(Token::Op(b'-')) | Some(Token::Op(b'+')) => true,
+            _ => false,
+        };
+        let base = self.unary()?;
+        if self.peek() != Some(Token::Op(b'^')) {
+            return Some(base);
+        }
+        if signed {
+            return None;
+        }
+        self.pos += 1;
+        let exponent = self.unary()?;
+        if self.peek() == Some(Token::Op(b'^')) {
+            return None;
+        }
+        Some(Node::binary(BinaryOp::Pow, base, exponent))
+    }
+
+    // unary := ('-' | '+') unary | primary
+    fn unary(&mut self) -> Option<Node> {
+        match self.peek()? {
+            Token::Op(b'-') => {
+                self.pos += 1;
+                Some(Node::unary(UnaryOp::Neg, self.unary()?))
+            }
+            Token::Op(b'+') => {
+                self.pos += 1;
+                self.unary()
+            }
+            _ => self.primary(),
+        }
+    }
+
+    fn primary(&mut self) -> Option<Node> {
+        match self.next()? {
+            Token::Num(v) => Some(Node::Const(v)),
+            Token::LParen => {
+                let node = self.expr()?;
+                self.expect(Token::RParen)?;
+                Some(node)
+            }
+            Token::Ident(name) => {
+                if self.peek() == Some(Token::LParen) {
+                    self.pos += 1;
+                    self.call(&name_key(name))
+                } else if let Some(var_id) = self.symbols.get_var_id(name).ok()? {
+                    Some(Node::Var(var_id))
+                } else {
+                    self.symbols.constant_value(name).map(Node::Const)
+                }
+            }
+            _ => None,
+        }
+    }
+
+    // Arguments of a function call, the opening parenthesis was already read
+    fn call(&mut self, name: &str) -> Option<Node> {
+        let mut args = vec![self.expr()?];
+        while self.peek() == Some(Token::Comma) {
+            self.pos += 1;
+            args.push(self.expr()?);
+        }
+        self.expect(Token::RParen)?;
+
+        if let Some((func, n_args)) = self.symbols.vec_func_id(name) {
+            if args.len() != n_args {
+                return None;
+            }
+            return Some(Node::Call(func, args));
+        }
+        if let Some(op) = UnaryOp::from_name(name) {
+            if args.len() != 1 {
+                return None;
+            }
+            return Some(Node::unary(op, args.pop().unwrap()));
+        }
+        let op = match name {
+            "min" => BinaryOp::Min,
+            "max" => BinaryOp::Max,
+            _ => return None,
+        };
+        if args.len() < 2 {
+            return None;
+        }
+        let mut args = args.into_iter();
+        let first = args.next().unwrap();
+        Some(args.fold(first, |a, b| Node::binary(op, a, b)))
+    }
+}
@@ -0,0 +1,367 @@
+//! Compilation of simple formulas to native code (requires the `jit` feature)
+
+use libc::c_double;
+
+use super::ir::{self, Node};
+use super::*;
+
+/// Signature of the compiled code: takes the variable slots of the symbol table
+/// (in the order of the variable IDs) and returns the result.
+type JitFn = unsafe extern "C" fn(*const *mut c_double) -> c_double;
+
+/// An expression that is compiled to native code if possible.
+///
+/// The formula is parsed again on the Rust side (see `BlockEvaluator` for the
+/// supported syntax) and translated to machine code, which reads the variables
+/// directly from the value slots of the symbol table, so changes to variables
+/// take effect as usual. Expressions that cannot be compiled, as well as
+/// targets other than x86-64 (Unix), are transparently evaluated by ExprTk
+/// (see `is_compiled`).
+///
+/// As with `BlockEvaluator`, the results can differ from ExprTk in the
+/// last bits.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+/// let expr = Expression::new("(x + 1) * (x - 1) / 2", symbol_table).unwrap();
+/// let mut jit_expr = JitExpression::new(expr);
+///
+/// *jit_expr.expression_mut().symbols_mut().value_mut(x_id) = 3.;
+/// assert_eq!(jit_expr.value(), 4.);
+/// ```
+pub struct JitExpression {
+    expr: Expression,
+    code: Option<native::Code>,
+}
+
+impl JitExpression {
+    pub fn new(expr: Expression) -> JitExpression {
+        // calls of functions added with `add_vec_func` are not supported
+        let code = ir::parse(expr.formula(), expr.symbols())
+            .filter(|n| !n.has_calls())
+            .and_then(|n| native::compile(&n));
+        JitExpression { expr, code }
+    }
+
+    /// Returns `true` if the expression was compiled to native code, or `false`
+    /// if it is evaluated by ExprTk.
+    pub fn is_compiled(&self) -> bool {
+        self.code.is_some()
+    }
+
+    /// Calculates the value of the expression
+    #[inline]
+    pub fn value(&mut self) -> c_double {
+        match self.code {
+            Some(ref code) => unsafe { (code.func())(self.expr.symbols().value_ptrs()) },
+            None => self.expr.value(),
+        }
+    }
+
+    /// Returns a reference to the expression
+    pub fn expression(&self) -> &Expression {
+        &self.expr
+    }
+
+    /// Returns a mutable reference to the expression, e.g. for changing the
+    /// values of variables.
+    pub fn expression_mut(&mut self) -> &mut Expression {
+        &mut self.expr
+    }
+
+    /// Returns the expression
+    pub fn into_inner(self) -> Expression {
+        self.expr
+    }
+}
+
+#[cfg(not(all(target_arch = "x86_64", unix)))]
+mod native {
+    use super::*;
+
+    pub enum Code {}
+
+    impl Code {
+        pub fn func(&self) -> JitFn {
+            match *self {}
+        }
+    }
+
+    pub fn compile(_: &Node) -> Option<Code> {
+        None
+    }
+}
+
+/// Code generation for x86-64 (System V ABI) using scalar SSE2 instructions.
+///
+/// The code is generated directly from the tree: the result of each node is
+/// left in `xmm0`. Before evaluating the right operand of a binary operation,
+/// the left one is spilled to the stack frame (unless the right operand is a
+/// constant or a variable, which are loaded into `xmm1` directly). Operations
+/// without an SSE2 instruction are calls to Rust functions.
+#[cfg(all(target_arch = "x86_64", unix))]
+mod native {
+    use std::mem;
+    use std::ptr;
+    use std::slice;
+
+    use super::*;
+    use crate::ir::{BinaryOp, UnaryOp};
+
+    /// Executable memory containing a compiled function
+    pub struct Code {
+        ptr: *mut libc::c_void,
+        len: usize,
+    }
+
+    unsafe impl Send for Code {}
+    unsafe impl Sync for Code {}
+
+    impl Code {
+        fn new(bytes: &[u8]) -> Option<Code> {
+            unsafe {
+                let len = bytes.len();
+                let ptr = libc::mmap(
+                    ptr::null_mut(),
+                    len,
+                    libc::PROT_READ | libc::PROT_WRITE,
+                    libc::MAP_PRIVATE | libc::MAP_ANONYMOUS,
+                    -1,
+                    0,
+                );
+                if ptr == libc::MAP_FAILED {
+                    return None;
+                }
+                slice::from_raw_parts_mut(ptr as *mut u8, len).copy_from_slice(bytes);
+                if libc::mprotect(ptr, len, libc::PROT_READ | libc::PROT_EXEC) != 0 {
+                    libc::munmap(ptr, len);
+                    return None;
+                }
+                Some(Code { ptr, len })
+            }
+        }
+
+        #[inline]
+        pub fn func(&self) -> JitFn {
+            unsafe { mem::transmute(self.ptr) }
+        }
+    }
+
+    impl Drop for Code {
+        fn drop(&mut self) {
+            unsafe { libc::munmap(self.ptr, self.len) };
+        }
+    }
+
+    pub fn compile(node: &Node) -> Option<Code> {
+        let mut a = Assembler {
+            code: vec![],
+            depth: 0,
+        };
+        let frame_slots = max_spills(node);
+        // 8 bytes per spilled value, rounded up to keep the stack 16-byte aligned
+        // (push rbx already aligned it)
+        let frame_size = ((frame_slots * 8 + 15) / 16 * 16) as u32;
+
+        // prologue: rbx holds the pointer to the variable slots
+        a.emit(&[0x53]); // push rbx
+        a.emit(&[0x48, 0x89, 0xfb]); // mov rbx, rdi
+        if frame_size > 0 {
+            a.emit(&[0x48, 0x81, 0xec]); // sub rsp, imm32
+            a.emit(&frame_size.to_le_bytes());
+        }
+        a.node(node);
+        if frame_size > 0 {
+            a.emit(&[0x48, 0x81, 0xc4]); // add rsp, imm32
+            a.emit(&frame_size.to_le_bytes());
+        }
+        a.emit(&[0x5b]); // pop rbx
+        a.emit(&[0xc3]); // ret
+        Code::new(&a.code)
+    }
+
+    /// Returns the number of stack slots needed for spilling
+    fn max_spills(node: &Node) -> usize {
+        match *node {
+            Node::Const(_) | Node::Var(_) => 0,
+            Node::Unary(_, ref a) => max_spills(a),
+            Node::Binary(_, ref a, ref b) => {
+                if is_leaf(b) {
+                    max_spills(a)
+                } else {
+                    max_spills(a).max(1 + max_spills(b))
+                }
+            }
+            Node::Call(..) => unreachable!(),
+        }
+    }
+
+    fn is_leaf(node: &Node) -> bool {
+        match *node {
+            Node::Const(_) | Node::Var(_) => true,
+            _ => false,
+        }
+    }
+
+    struct Assembler {
+        code: Vec<u8>,
+        // number of values currently spilled to the stack frame
+        depth: usize,
+    }
+
+    // Registers (only used in ModRM bytes)
+    const XMM0: u8 = 0;
+    const XMM1: u8 = 1;
+
+    impl Assembler {
+        fn emit(&mut self, bytes: &[u8]) {
+            self.code.extend_from_slice(bytes);
+        }
+
+        /// Evaluates a node into xmm0
+        fn node(&mut self, node: &Node) {
+            match *node {
+                Node::Const(c) => self.load_const(XMM0, c),
+                Node::Var(var_id) => self.load_var(XMM0, var_id),
+                Node::Unary(op, ref a) => {
+                    self.node(a);
+                    self.unary(op);
+                }
+                Node::Binary(op, ref a, ref b) => {
+                    self.node(a);
+                    match **b {
+                        Node::Const(c) => self.load_const(XMM1, c),
+                        Node::Var(var_id) => self.load_var(XMM1, var_id),
+                        ref b => {
+                            let slot = self.depth;
+                            self.depth += 1;
+                            self.spill(slot);
+                            self.node(b);
+                            self.sse(0x66, 0x28, XMM1, XMM0); // movapd xmm1, xmm0
+                            self.unspill(slot);
+                            self.depth -= 1;
+                        }
+                    }
+                    self.binary(op);
+                }
+                Node::Call(..) => unreachable!(),
+            }
+        }
+
+        // Scalar SSE2 instruction with register operands: `op dst, src`
+        fn sse(&mut self, prefix: u8, opcode: u8, dst: u8, src: u8) {
+            self.emit(&[prefix, 0x0f, opcode, 0xc0 | (dst << 3) | src]);
+        }
+
+        fn load_const(&mut self, xmm: u8, value: c_double) {
+            self.emit(&[0x48, 0xb8]); // movabs rax, imm64
+            self.emit(&value.to_bits().to_le_bytes());
+            self.emit(&[0x66, 0x48, 0x0f, 0x6e, 0xc0 | (xmm << 3)]); // movq xmm, rax
+        }
+
+        fn load_var(&mut self, xmm: u8, var_id: usize) {
+            // mov rax, [rbx + disp32]
+            self.emit(&[0x48, 0x8b, 0x83]);
+            self.emit(&((var_id * 8) as u32).to_le_bytes());
+            // movsd xmm, [rax]
+            self.emit(&[0xf2, 0x0f, 0x10, xmm << 3]);
+        }
+
+        fn spill(&mut self, slot: usize) {
+            // movsd [rsp + disp32], xmm0
+            self.emit(&[0xf2, 0x0f, 0x11, 0x84, 0x24]);
+            self.emit(&((slot * 8) as u32).to_le_bytes());
+        }
+
+        fn unspill(&mut self, slot: usize) {
+            // movsd xmm0, [rsp + disp32]
+            self.emit(&[0xf2, 0x0f, 0x10, 0x84, 0x24]);
+            self.emit(&((slot * 8) as u32).to_le_bytes());
+        }
+
+        fn call(&mut self, func: usize) {
+            self.emit(&[0x48, 0xb8]); // movabs rax, imm64
+            self.emit(&(func as u64).to_le_bytes());
+            self.emit(&[0xff, 0xd0]); // call rax
+        }
+
+        fn unary(&mut self, op: UnaryOp) {
+            match op {
+                UnaryOp::Neg => {
+                    self.load_const(XMM1, -0.);
+                    self.sse(0x66, 0x57, XMM0, XMM1); // xorpd
+                }
+                UnaryOp::Abs => {
+                    self.load_const(XMM1, c_double::from_bits(!(1 << 63)));
+                    self.sse(0x66, 0x54, XMM0, XMM1); // andpd
+                }
+                UnaryOp::Sqrt => self.sse(0xf2, 0x51, XMM0, XMM0), // sqrtsd
+                op => self.call(unary_fn(op) as usize),
+            }
+        }
+
+        // Operands in xmm0 and xmm1
+        fn binary(&mut self, op: BinaryOp) {
+            match op {
+                BinaryOp::Add => self.sse(0xf2, 0x58, XMM0, XMM1), // addsd
+                BinaryOp::Sub => self.sse(0xf2, 0x5c, XMM0, XMM1), // subsd
+                BinaryOp::Mul => self.sse(0xf2, 0x59, XMM0, XMM1), // mulsd
+                BinaryOp::Div => self.sse(0xf2, 0x5e, XMM0, XMM1), // divsd
+                // minsd / maxsd return the second operand if the comparison
+                // is false, which (with swapped operands) gives the same
+                // result as BinaryOp::apply, also for NaN.
+                BinaryOp::Min => {
+                    self.sse(0xf2, 0x5d, XMM1, XMM0); // minsd xmm1, xmm0
+                    self.sse(0x66, 0x28, XMM0, XMM1); // movapd xmm0, xmm1
+                }
+                BinaryOp::Max => {
+                    self.sse(0xf2, 0x5f, XMM1, XMM0); // maxsd xmm1, xmm0
+                    self.sse(0x66, 0x28, XMM0, XMM1); // movapd xmm0, xmm1
+                }
+                op => self.call(binary_fn(op) as usize),
+            }
+        }
+    }
+
+    // Functions called by the compiled code for operations without an instruction
+
+    macro_rules! op_fns {
+        ($ty:ident, $($op:ident: $name:ident($($arg:ident),*)),*) => {
+            $(
+                extern "C" fn $name($($arg: c_double),*) -> c_double {
+                    $ty::$op.apply($($arg),*)
+                }
+            )*
+        };
+    }
+
+    op_fns!(UnaryOp, Exp: op_exp(x), Log: op_log(x), Log10: op_log10(x), Sin: op_sin(x),
+        Cos: op_cos(x), Tan: op_tan(x), Floor: op_floor(x), Ceil: op_ceil(x));
+    op_fns!(BinaryOp, Rem: op_rem(a, b), Pow: op_pow(a, b));
+
+    fn unary_fn(op: UnaryOp) -> extern "C" fn(c_double) -> c_double {
+        match op {
+            UnaryOp::Exp => op_exp,
+            UnaryOp::Log => op_log,
+            UnaryOp::Log10 => op_log10,
+            UnaryOp::Sin => op_sin,
+            UnaryOp::Cos => op_cos,
+            UnaryOp::Tan => op_tan,
+            UnaryOp::Floor => op_floor,
+            UnaryOp::Ceil => op_ceil,
+            UnaryOp::Neg | UnaryOp::Abs | UnaryOp::Sqrt => unreachable!(),
+        }
+    }
+
+    fn binary_fn(op: BinaryOp) -> extern "C" fn(c_double, c_double) -> c_double {
+        match op {
+            BinaryOp::Rem => op_rem,
+            BinaryOp::Pow => op_pow,
+            _ => unreachable!(),
+        }
+    }
+}
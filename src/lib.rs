@@ -5,7 +5,9 @@
 //! While `exprtk-sys` maps most functions of the library to Rust, the high level bindings
 //! were considerably simplified. Each [Expression](struct.Expression.html) owns a
 //! [SymbolTable](struct.SymbolTable.html), they cannot be shared between different instances,
-//! and multiple symbol tables per expression are not possible.
+//! and multiple symbol tables per expression are not possible. Only
+//! [CompactExpression](struct.CompactExpression.html) uses a symbol table shared by
+//! reference, which reduces the memory needed for many resident expressions.
 //!
 //! Variables are owned by the `SymbolTable` instance. The functions for adding variables
 //! ([add_variable()](exprtk/struct.SymbolTable.html#method.add_variable)), strings
@@ -118,22 +120,68 @@
 //! let mut expr = Expression::new("add(x, 1)", symbol_table).unwrap();
 //! assert_eq!(expr.value(), 2.);
 //! ```
+//!
+//! # Cargo features
+//!
+//! Most features correspond to ExprTk compile-time options and are enabled by default
+//! (`all`). Additional optional features are:
+//!
+//! * `parallel`: multithreaded evaluation with [ParallelEvaluator](struct.ParallelEvaluator.html)
+//!   and compilation with [compile_many](fn.compile_many.html), based on
+//!   [rayon](https://docs.rs/rayon)
+//! * `jit`: compilation of simple formulas to native code with
+//!   [JitExpression](struct.JitExpression.html) (x86-64 only)
+//! * `stats`: compile time and evaluation latency statistics for each expression
+//!   (see [Stats](struct.Stats.html))
+//! * `arrow`: evaluation over [Arrow](https://docs.rs/arrow) record batches with
+//!   [ArrowEvaluator](struct.ArrowEvaluator.html)
 
 #[macro_use]
 extern crate enum_primitive;
 
+#[cfg(feature = "arrow")]
+pub use arrow_eval::*;
+pub use block::*;
+pub use budget::*;
+pub use cache::*;
+pub use compact::*;
 pub use error::*;
 pub use exprtk::*;
+pub use incremental::*;
+#[cfg(feature = "jit")]
+pub use jit::*;
 pub use libc::c_double;
+#[cfg(feature = "parallel")]
+pub use parallel::*;
+pub use set::*;
+#[cfg(feature = "stats")]
+pub use stats::*;
 
-macro_rules! string_from_ptr {
+/// Copies a `CStrView` borrowed from C++ into a `String`
+macro_rules! string_from_view {
     ($s:expr) => {
-        CStr::from_ptr($s).to_string_lossy().into_owned()
+        String::from_utf8_lossy($s.as_bytes()).into_owned()
     };
 }
 
+#[cfg(feature = "arrow")]
+mod arrow_eval;
+mod block;
+mod budget;
+mod cache;
+mod compact;
 mod error;
 mod exprtk;
+mod incremental;
+mod ir;
+#[cfg(feature = "jit")]
+mod jit;
+#[cfg(feature = "parallel")]
+mod parallel;
+mod serialize;
+mod set;
+#[cfg(feature = "stats")]
+mod stats;
 
 #[cfg(test)]
 mod tests;
@@ -0,0 +1,207 @@
+//! Multithreaded evaluation of an expression over columnar input and
+//! compilation of many formulas (requires the `parallel` feature).
+
+use std::sync::Mutex;
+
+use libc::c_double;
+use rayon::prelude::*;
+
+use super::exprtk::BatchValue;
+use super::*;
+
+/// Default number of rows evaluated at once by a thread
+const DEFAULT_CHUNK_SIZE: usize = 4096;
+
+/// Evaluates one formula over large batches of columnar input using the
+/// [rayon](https://docs.rs/rayon) thread pool.
+///
+/// The expression is compiled once, and then cloned for every thread of the pool.
+/// The rows of a batch are split into chunks, which are distributed over the
+/// threads by work-stealing. Every chunk is evaluated with `Expression::eval_batch`
+/// by the instance belonging to the thread, writing into its own part of the output.
+///
+/// Since every thread works with its own clone, side effects of the expression
+/// (e.g. assignments to variables) are not shared between the instances.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+/// let expr = Expression::new("x^2 + 1", symbol_table).unwrap();
+/// let evaluator = ParallelEvaluator::new(expr);
+///
+/// let x: Vec<f64> = (0..100_000).map(|i| i as f64).collect();
+/// let mut out = vec![0.; x.len()];
+/// evaluator.eval_batch(&[(x_id, &x)], &mut out);
+/// assert_eq!(out[3], 10.);
+/// ```
+pub struct ParallelEvaluator {
+    instances: Vec<Mutex<Expression>>,
+    chunk_size: usize,
+}
+
+impl ParallelEvaluator {
+    /// Creates a new evaluator with one expression instance per thread
+    /// of the current rayon thread pool.
+    pub fn new(expr: Expression) -> ParallelEvaluator {
+        Self::with_instances(expr, rayon::current_num_threads())
+    }
+
+    /// Creates a new evaluator with `n` instances of the expression. If
+    /// there are more threads than instances, threads share instances.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if `n` is zero.
+    pub fn with_instances(expr: Expression, n: usize) -> ParallelEvaluator {
+        assert!(n > 0, "At least one expression instance is required");
+        let mut instances: Vec<_> = expr.clones(n - 1).into_iter().map(Mutex::new).collect();
+        instances.push(Mutex::new(expr));
+        ParallelEvaluator {
+            instances,
+            chunk_size: DEFAULT_CHUNK_SIZE,
+        }
+    }
+
+    /// Sets the number of rows that are evaluated at once by a thread (default: 4096).
+    /// Smaller chunks balance the work better, larger ones have less overhead.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if `chunk_size` is zero.
+    pub fn chunk_size(mut self, chunk_size: usize) -> ParallelEvaluator {
+        assert!(chunk_size > 0, "Chunk size must not be zero");
+        self.chunk_size = chunk_size;
+        self
+    }
+
+    /// Returns the number of expression instances
+    pub fn num_instances(&self) -> usize {
+        self.instances.len()
+    }
+
+    /// Calls `func` with every expression instance, e.g. to modify variables
+    /// that are not supplied as columns in `eval_batch`.
+    pub fn for_each_instance<F>(&mut self, mut func: F)
+    where
+        F: FnMut(&mut Expression),
+    {
+        for e in &mut self.instances {
+            func(e.get_mut().unwrap());
+        }
+    }
+
+    /// Evaluates the expression for every row of columnar input in parallel.
+    /// Arguments are the same as for `Expression::eval_batch`.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    pub fn eval_batch(&self, columns: &[(usize, &[c_double])], out: &mut [c_double]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    /// Evaluates the expression for every row of single precision columnar input
+    /// in parallel, like `Expression::eval_batch_f32`.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if a variable ID is invalid, or if the length of
+    /// a column differs from the length of `out`.
+    pub fn eval_batch_f32(&self, columns: &[(usize, &[f32])], out: &mut [f32]) {
+        self.eval_batch_generic(columns, out)
+    }
+
+    fn eval_batch_generic<T: BatchValue>(&self, columns: &[(usize, &[T])], out: &mut [T]) {
+        for &(_, column) in columns {
+            assert_eq!(
+                column.len(),
+                out.len(),
+                "Column length does not match the output length"
+            );
+        }
+        let chunk_size = self.chunk_size;
+        out.par_chunks_mut(chunk_size)
+            .enumerate()
+            .for_each(|(i, out_chunk)| {
+                let start = i * chunk_size;
+                let end = start + out_chunk.len();
+                let chunk_columns: Vec<_> = columns
+                    .iter()
+                    .map(|&(var_id, column)| (var_id, &column[start..end]))
+                    .collect();
+                // uncontended unless the pool has more threads than instances
+                let thread_i = rayon::current_thread_index().unwrap_or(0) % self.instances.len();
+                let mut expr = self.instances[thread_i].lock().unwrap();
+                expr.eval_batch_generic(&chunk_columns, out_chunk);
+            });
+    }
+}
+
+/// Compiles many formulas in parallel using the [rayon](https://docs.rs/rayon)
+/// thread pool. Every expression gets its own clone of the `template` symbol
+/// table. The results are returned in the order of the formulas.
+///
+/// ExprTk parsers are not thread-safe, therefore every thread compiles with
+/// parsers from its own thread-local pool (see `Parser::with_pooled`), which
+/// are reused for all formulas compiled by this thread.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut template = SymbolTable::new();
+/// template.add_variable("x", 2.).unwrap();
+/// let formulas: Vec<_> = (0..100).map(|i| format!("x * {}", i)).collect();
+/// let exprs = compile_many(&formulas, &template);
+/// assert_eq!(exprs.len(), 100);
+/// assert_eq!(exprs[21].as_ref().unwrap().clone().value(), 42.);
+/// ```
+pub fn compile_many<S>(
+    formulas: &[S],
+    template: &SymbolTable,
+) -> Vec<Result<Expression, ParseError>>
+where
+    S: AsRef<str> + Sync,
+{
+    formulas
+        .par_iter()
+        .map(|f| Expression::new(f.as_ref(), template.clone()))
+        .collect()
+}
+
+/// Compiles many formulas in parallel like `compile_many`, handling unknown
+/// symbols with `func` like `Expression::handle_unknown` does. The closure
+/// receives the symbol table of the expression that is being compiled, and it
+/// may be called from several threads at the same time.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let formulas = ["a + b", "a * c"];
+/// let exprs = compile_many_resolve(&formulas, &SymbolTable::new(), |name, s| {
+///     s.add_variable(name, 2.).unwrap();
+///     Ok(())
+/// });
+/// let mut e = exprs.into_iter().nth(1).unwrap().unwrap();
+/// assert_eq!(e.symbols().get_variable_names(), vec!["a", "c"]);
+/// assert_eq!(e.value(), 4.);
+/// ```
+pub fn compile_many_resolve<S, F>(
+    formulas: &[S],
+    template: &SymbolTable,
+    func: F,
+) -> Vec<Result<Expression, ParseError>>
+where
+    S: AsRef<str> + Sync,
+    F: Fn(&str, &mut SymbolTable) -> Result<(), String> + Sync,
+{
+    formulas
+        .par_iter()
+        .map(|f| Expression::handle_unknown(f.as_ref(), template.clone(), |n, s| func(n, s)))
+        .collect()
+}
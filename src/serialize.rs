@@ -0,0 +1,147 @@
+//! Binary format for storing formulas together with the layout of their
+//! symbol table, which is validated when loading them.
+
+use std::str;
+
+use exprtk_sys::{BUILD_ID, CASE_INSENSITIVE};
+
+use super::*;
+
+const MAGIC: &[u8; 4] = b"EXTK";
+const FORMAT_VERSION: u32 = 1;
+
+/// Features of this crate, which change how formulas are compiled or how
+/// symbol names are looked up on the Rust side (e.g. case insensitivity,
+/// see `SymbolTable::get_var_id`)
+fn crate_features() -> String {
+    let features = [
+        ("caseinsensitivity", CASE_INSENSITIVE),
+        ("jit", cfg!(feature = "jit")),
+        ("parallel", cfg!(feature = "parallel")),
+        ("stats", cfg!(feature = "stats")),
+        ("arrow", cfg!(feature = "arrow")),
+    ];
+    let enabled: Vec<_> = features
+        .iter()
+        .filter(|&&(_, on)| on)
+        .map(|&(name, _)| name)
+        .collect();
+    enabled.join(",")
+}
+
+/// Identifies the crate version and features together with the ExprTk
+/// revision and the features of `exprtk_sys`.
+fn build_fingerprint() -> u64 {
+    let mut hash: u64 = 0xcbf2_9ce4_8422_2325;
+    let features = crate_features();
+    for &b in env!("CARGO_PKG_VERSION")
+        .as_bytes()
+        .iter()
+        .chain(&[b':'])
+        .chain(features.as_bytes())
+        .chain(&[b':'])
+        .chain(BUILD_ID.as_bytes())
+    {
+        hash ^= u64::from(b);
+        hash = hash.wrapping_mul(0x0100_0000_01b3);
+    }
+    hash
+}
+
+fn write_bytes(out: &mut Vec<u8>, data: &[u8]) {
+    out.extend_from_slice(&(data.len() as u32).to_le_bytes());
+    out.extend_from_slice(data);
+}
+
+fn read_bytes<'a>(blob: &mut &'a [u8], n: usize) -> Result<&'a [u8], LoadError> {
+    if blob.len() < n {
+        return Err(LoadError::InvalidFormat);
+    }
+    let (data, rest) = blob.split_at(n);
+    *blob = rest;
+    Ok(data)
+}
+
+fn read_u32(blob: &mut &[u8]) -> Result<u32, LoadError> {
+    let mut b = [0; 4];
+    b.copy_from_slice(read_bytes(blob, 4)?);
+    Ok(u32::from_le_bytes(b))
+}
+
+fn read_str<'a>(blob: &mut &'a [u8]) -> Result<&'a str, LoadError> {
+    let n = read_u32(blob)? as usize;
+    str::from_utf8(read_bytes(blob, n)?).map_err(|_| LoadError::InvalidFormat)
+}
+
+impl Expression {
+    /// Appends the formula of the expression to `out`, together with the layout
+    /// of its symbol table, so that it can be loaded again with
+    /// `Expression::deserialize`. Several expressions can be written to the
+    /// same buffer. This is a store of formulas that are validated when
+    /// loading, not a compiled form.
+    ///
+    /// The data contain the formula and the layout of the symbol table (names
+    /// of constants, variables, strings, vectors with their sizes and functions
+    /// in the order of their IDs), but not the values of the variables. A header
+    /// identifies the crate version, the ExprTk revision and the enabled features.
+    ///
+    /// **Note**: ExprTk cannot export its compiled node tree, therefore the
+    /// formula is compiled again by `deserialize`, which takes as long as
+    /// `Expression::new`.
+    ///
+    /// # Example:
+    /// ```
+    /// use exprtk_rs::*;
+    ///
+    /// let mut blob = vec![];
+    /// for formula in &["x + 1", "x * y"] {
+    ///     let (expr, _) = Expression::parse_vars(formula, SymbolTable::new()).unwrap();
+    ///     expr.serialize(&mut blob);
+    /// }
+    ///
+    /// // e.g. in another process, using a memory-mapped file
+    /// let mut data = &blob[..];
+    /// let mut symbols = SymbolTable::new();
+    /// symbols.add_variable("x", 2.).unwrap();
+    /// let mut e1 = Expression::deserialize(&mut data, symbols.clone()).unwrap();
+    /// assert_eq!(e1.value(), 3.);
+    /// symbols.add_variable("y", 3.).unwrap();
+    /// let mut e2 = Expression::deserialize(&mut data, symbols).unwrap();
+    /// assert_eq!(e2.value(), 6.);
+    /// assert!(data.is_empty());
+    /// ```
+    pub fn serialize(&self, out: &mut Vec<u8>) {
+        out.extend_from_slice(MAGIC);
+        out.extend_from_slice(&FORMAT_VERSION.to_le_bytes());
+        out.extend_from_slice(&build_fingerprint().to_le_bytes());
+        write_bytes(out, self.symbols().signature().as_bytes());
+        write_bytes(out, self.formula().as_bytes());
+    }
+
+    /// Loads an expression written with `Expression::serialize` from the start
+    /// of `blob`, compiles its formula with `symbols` and advances `blob` to the
+    /// end of its data.
+    ///
+    /// The given symbol table must have the same layout as the one of the
+    /// serialized expression (same names and kinds of symbols in the same
+    /// order, same vector sizes), otherwise `LoadError::LayoutMismatch` is
+    /// returned. Data written by a different crate version, ExprTk revision or
+    /// feature set are rejected with `LoadError::VersionMismatch`.
+    pub fn deserialize(blob: &mut &[u8], symbols: SymbolTable) -> Result<Expression, LoadError> {
+        if read_bytes(blob, MAGIC.len())? != MAGIC {
+            return Err(LoadError::InvalidFormat);
+        }
+        let version = read_u32(blob)?;
+        let mut fingerprint = [0; 8];
+        fingerprint.copy_from_slice(read_bytes(blob, 8)?);
+        if version != FORMAT_VERSION || u64::from_le_bytes(fingerprint) != build_fingerprint() {
+            return Err(LoadError::VersionMismatch);
+        }
+        let signature = read_str(blob)?;
+        let formula = read_str(blob)?;
+        if symbols.signature() != signature {
+            return Err(LoadError::LayoutMismatch);
+        }
+        Ok(Expression::new(formula, symbols)?)
+    }
+}
@@ -0,0 +1,243 @@
+//! Evaluation of several formulas sharing common subexpressions
+
+use std::collections::HashMap;
+use std::slice;
+
+use libc::c_double;
+
+use exprtk_sys::*;
+
+use super::exprtk::MAX_VEC_FUNC_ARGS;
+use super::ir::{self, BinaryOp, Node, UnaryOp};
+use super::*;
+
+/// Evaluates several formulas using the same symbol table at once.
+///
+/// Simple formulas (the same subset as with `BlockEvaluator`) are translated
+/// into one common list of operations, in which identical subexpressions of all
+/// formulas are only present once. They are computed only once per call to
+/// `value_all`, and the evaluation happens entirely on the Rust side without
+/// walking the ExprTk node trees. `x + y` and `y + x` are recognized as being
+/// the same, other algebraic identities are not. Any other formula is compiled
+/// by ExprTk against the symbol table of the set itself, so no values need to
+/// be copied before evaluating it.
+///
+/// The values of variables, strings and vectors can be changed with
+/// `symbols_mut`, but no symbols should be added after constructing the set.
+/// Assignments to variables in formulas evaluated by ExprTk modify the symbol
+/// table of the set, and are seen by the formulas evaluated by ExprTk after
+/// them.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// let x_id = symbol_table.add_variable("x", 0.).unwrap().unwrap();
+/// symbol_table.add_variable("mu", 5.).unwrap();
+/// symbol_table.add_variable("sigma", 2.).unwrap();
+/// let formulas = [
+///     "(x - mu) / sigma",
+///     "((x - mu) / sigma)^2",
+///     "abs((x - mu) / sigma) * 10",
+/// ];
+/// let mut set = ExpressionSet::new(&formulas, symbol_table).unwrap();
+/// // the normalization is only computed once
+/// assert_eq!(set.op_count(), 10);
+/// assert_eq!(set.shared_count(), 10);
+///
+/// *set.symbols_mut().value_mut(x_id) = 9.;
+/// let mut out = [0.; 3];
+/// set.value_all(&mut out);
+/// assert_eq!(out, [2., 4., 20.]);
+/// ```
+pub struct ExpressionSet {
+    symbols: SymbolTable,
+    formulas: Vec<String>,
+    ops: Vec<Op>,
+    // results of the operations
+    values: Vec<c_double>,
+    outputs: Vec<Output>,
+    // formulas evaluated by ExprTk, compiled against `symbols`
+    exprs: Vec<*mut CExpression>,
+    // number of operations that were found more than once
+    shared: usize,
+}
+
+// The ExprTk expressions are only referenced by the set, which also owns the
+// symbol table they share, and are only evaluated through `&mut self`.
+unsafe impl Send for ExpressionSet {}
+unsafe impl Sync for ExpressionSet {}
+
+#[derive(Clone, Debug, PartialEq, Eq, Hash)]
+enum Op {
+    // constants are compared by their bits
+    Const(u64),
+    Var(usize),
+    Unary(UnaryOp, usize),
+    Binary(BinaryOp, usize, usize),
+    /// Function added with `add_vec_func` (index, arguments)
+    Call(usize, Vec<usize>),
+}
+
+#[derive(Clone, Copy, Debug)]
+enum Output {
+    /// Result of an operation
+    Op(usize),
+    /// Expression at the given index of `ExpressionSet::exprs`
+    Expr(usize),
+}
+
+impl ExpressionSet {
+    /// Compiles the formulas, returns the first `ParseError` if any of them is not valid.
+    pub fn new<S: AsRef<str>>(
+        formulas: &[S],
+        symbols: SymbolTable,
+    ) -> Result<ExpressionSet, ParseError> {
+        let mut set = ExpressionSet {
+            symbols,
+            formulas: Vec::with_capacity(formulas.len()),
+            ops: vec![],
+            values: vec![],
+            outputs: Vec::with_capacity(formulas.len()),
+            exprs: vec![],
+            shared: 0,
+        };
+        let mut lookup = HashMap::new();
+        for formula in formulas {
+            let formula = formula.as_ref();
+            let output = match ir::parse(formula, &set.symbols) {
+                Some(node) => Output::Op(set.add(&node, &mut lookup)),
+                None => {
+                    let expr = unsafe { expression_new() };
+                    // pushed first, so it is destroyed if compiling fails
+                    set.exprs.push(expr);
+                    unsafe { expression_register_symbol_table(expr, set.symbols.sym) };
+                    Parser::with_pooled(|parser| parser.compile_raw(formula, expr))?;
+                    Output::Expr(set.exprs.len() - 1)
+                }
+            };
+            set.formulas.push(formula.to_string());
+            set.outputs.push(output);
+        }
+        set.values = vec![0.; set.ops.len()];
+        Ok(set)
+    }
+
+    // Adds the operations of a node (if not already present), returns the index
+    // of its result
+    fn add(&mut self, node: &Node, lookup: &mut HashMap<Op, usize>) -> usize {
+        let op = match *node {
+            Node::Const(v) => Op::Const(v.to_bits()),
+            Node::Var(var_id) => Op::Var(var_id),
+            Node::Unary(op, ref a) => Op::Unary(op, self.add(a, lookup)),
+            Node::Binary(op, ref a, ref b) => {
+                let a = self.add(a, lookup);
+                let b = self.add(b, lookup);
+                match op {
+                    // commutative (also regarding NaN)
+                    BinaryOp::Add | BinaryOp::Mul if b < a => Op::Binary(op, b, a),
+                    _ => Op::Binary(op, a, b),
+                }
+            }
+            Node::Call(func, ref args) => {
+                Op::Call(func, args.iter().map(|a| self.add(a, lookup)).collect())
+            }
+        };
+        if let Some(&i) = lookup.get(&op) {
+            self.shared += 1;
+            return i;
+        }
+        self.ops.push(op.clone());
+        lookup.insert(op, self.ops.len() - 1);
+        self.ops.len() - 1
+    }
+
+    /// Returns the number of formulas
+    pub fn len(&self) -> usize {
+        self.formulas.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.formulas.is_empty()
+    }
+
+    /// Returns the formulas in the order of the output values
+    pub fn formulas(&self) -> &[String] {
+        &self.formulas
+    }
+
+    /// Returns the number of distinct operations evaluated on the Rust side
+    pub fn op_count(&self) -> usize {
+        self.ops.len()
+    }
+
+    /// Returns the number of nodes of the formulas (including variables and
+    /// numbers) that were found to be identical to a previous one, in the
+    /// same or another formula, and are thus not evaluated separately
+    pub fn shared_count(&self) -> usize {
+        self.shared
+    }
+
+    /// Returns the number of formulas that are evaluated by ExprTk
+    pub fn fallback_count(&self) -> usize {
+        self.exprs.len()
+    }
+
+    pub fn symbols(&self) -> &SymbolTable {
+        &self.symbols
+    }
+
+    pub fn symbols_mut(&mut self) -> &mut SymbolTable {
+        &mut self.symbols
+    }
+
+    /// Evaluates all formulas and writes their values to `out` (in the order
+    /// of the formulas).
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the length of `out` differs from the number
+    /// of formulas.
+    pub fn value_all(&mut self, out: &mut [c_double]) {
+        assert_eq!(
+            out.len(),
+            self.formulas.len(),
+            "Output length does not match the number of formulas"
+        );
+        for i in 0..self.ops.len() {
+            let v = &self.values;
+            let value = match self.ops[i] {
+                Op::Const(bits) => c_double::from_bits(bits),
+                Op::Var(var_id) => self.symbols.value(var_id),
+                Op::Unary(op, a) => op.apply(v[a]),
+                Op::Binary(op, a, b) => op.apply(v[a], v[b]),
+                Op::Call(func, ref args) => {
+                    let mut arg_slices: [&[c_double]; MAX_VEC_FUNC_ARGS] = [&[]; MAX_VEC_FUNC_ARGS];
+                    for (s, &a) in arg_slices.iter_mut().zip(args) {
+                        *s = slice::from_ref(&v[a]);
+                    }
+                    let mut res = [0.];
+                    self.symbols
+                        .call_vec_func(func, &arg_slices[..args.len()], &mut res);
+                    res[0]
+                }
+            };
+            self.values[i] = value;
+        }
+        for (o, output) in out.iter_mut().zip(&self.outputs) {
+            *o = match *output {
+                Output::Op(i) => self.values[i],
+                Output::Expr(i) => unsafe { expression_value(self.exprs[i]) },
+            };
+        }
+    }
+}
+
+impl Drop for ExpressionSet {
+    fn drop(&mut self) {
+        for &expr in &self.exprs {
+            unsafe { expression_destroy(expr) };
+        }
+    }
+}
@@ -0,0 +1,125 @@
+//! Instrumentation of compilation and evaluation (requires the `stats` feature)
+
+use std::iter::Sum;
+use std::time::Duration;
+
+/// Number of buckets of the evaluation latency histogram
+pub const N_LATENCY_BUCKETS: usize = 32;
+
+/// Statistics about the compilation and evaluation of an `Expression`,
+/// available with `Expression::stats` if the `stats` feature is enabled.
+///
+/// The compile time is recorded by the constructors of `Expression`, and
+/// every call to `Expression::value` or `value_with_budget` is timed (other
+/// evaluation methods such as `eval_batch` are not recorded). Statistics of
+/// different expressions, e.g. evaluated in different threads, can be combined
+/// with `merge` or `sum`.
+///
+/// ExprTk does not allow inspecting the compiled node tree or timing the
+/// different compilation stages separately. Therefore the number of nodes
+/// and the depth of the tree are not available, the number of tokens of the
+/// formula is reported instead as a measure of its size, along with the total
+/// compile time.
+///
+/// # Example:
+/// ```
+/// use exprtk_rs::*;
+///
+/// let mut symbol_table = SymbolTable::new();
+/// symbol_table.add_variable("x", 1.).unwrap();
+/// let mut expr = Expression::new("x^2 + 1", symbol_table).unwrap();
+/// for _ in 0..10 {
+///     expr.value();
+/// }
+/// let stats = expr.stats();
+/// assert_eq!(stats.compilations, 1);
+/// assert!(stats.tokens > 0);
+/// assert_eq!(stats.evaluations, 10);
+/// assert!(stats.eval_time_quantile(0.5).unwrap() <= stats.eval_time_quantile(1.).unwrap());
+/// ```
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Stats {
+    /// Number of successful compilations
+    pub compilations: u64,
+    /// Total time spent compiling
+    pub compile_time: Duration,
+    /// Total number of tokens of the compiled formulas
+    pub tokens: u64,
+    /// Number of evaluations
+    pub evaluations: u64,
+    /// Total time spent evaluating
+    pub eval_time: Duration,
+    /// Histogram of evaluation latencies: bucket `i` counts the evaluations taking
+    /// less than 2<sup>i</sup> ns (and at least 2<sup>i-1</sup> ns). The last
+    /// bucket also counts all slower evaluations.
+    pub eval_histogram: [u64; N_LATENCY_BUCKETS],
+}
+
+impl Stats {
+    #[inline]
+    pub(crate) fn record_compile(&mut self, elapsed: Duration, tokens: usize) {
+        self.compilations += 1;
+        self.compile_time += elapsed;
+        self.tokens += tokens as u64;
+    }
+
+    #[inline]
+    pub(crate) fn record_eval(&mut self, elapsed: Duration) {
+        self.evaluations += 1;
+        self.eval_time += elapsed;
+        let nanos = elapsed.as_nanos().min(u64::max_value() as u128) as u64;
+        let bucket = (64 - nanos.leading_zeros() as usize).min(N_LATENCY_BUCKETS - 1);
+        self.eval_histogram[bucket] += 1;
+    }
+
+    /// Adds the statistics of `other` to `self`
+    pub fn merge(&mut self, other: &Stats) {
+        self.compilations += other.compilations;
+        self.compile_time += other.compile_time;
+        self.tokens += other.tokens;
+        self.evaluations += other.evaluations;
+        self.eval_time += other.eval_time;
+        for (b, o) in self.eval_histogram.iter_mut().zip(&other.eval_histogram) {
+            *b += o;
+        }
+    }
+
+    /// Returns the mean evaluation time, or `None` if there were no evaluations
+    pub fn mean_eval_time(&self) -> Option<Duration> {
+        if self.evaluations == 0 {
+            return None;
+        }
+        let nanos = self.eval_time.as_nanos() / self.evaluations as u128;
+        Some(Duration::from_nanos(
+            nanos.min(u64::max_value() as u128) as u64
+        ))
+    }
+
+    /// Returns an upper bound for the given quantile (between 0 and 1) of the
+    /// evaluation latencies, based on the histogram. Returns `None` if there
+    /// were no evaluations.
+    pub fn eval_time_quantile(&self, q: f64) -> Option<Duration> {
+        if self.evaluations == 0 {
+            return None;
+        }
+        let target = (q.max(0.).min(1.) * self.evaluations as f64).ceil().max(1.) as u64;
+        let mut n = 0;
+        for (i, &count) in self.eval_histogram.iter().enumerate() {
+            n += count;
+            if n >= target {
+                return Some(Duration::from_nanos(1 << i));
+            }
+        }
+        Some(Duration::from_nanos(1 << (N_LATENCY_BUCKETS - 1)))
+    }
+}
+
+impl<'a> Sum<&'a Stats> for Stats {
+    fn sum<I: Iterator<Item = &'a Stats>>(iter: I) -> Stats {
+        let mut out = Stats::default();
+        for s in iter {
+            out.merge(s);
+        }
+        out
+    }
+}
@@ -29,6 +29,27 @@ fn test_string() {
     assert_relative_eq!(e.value(), 8.);
 }
 
+#[test]
+fn test_string_capacity() {
+    let mut s = SymbolTable::new();
+    let s_id = s
+        .add_stringvar_with_capacity("s", "abc", 64)
+        .unwrap()
+        .unwrap();
+    assert!(s.string(s_id).capacity() >= 64);
+    let ptr = s.string(s_id).get_bytes().as_ptr();
+    let mut e = Expression::new("s[]", s).unwrap();
+    assert_relative_eq!(e.value(), 3.);
+    e.symbols_mut().string_mut(s_id).set_bytes(b"\xff\xfe\x00x");
+    assert_relative_eq!(e.value(), 4.);
+    assert_eq!(e.symbols().string(s_id).get_bytes(), b"\xff\xfe\x00x");
+    // no reallocation within the reserved capacity
+    assert_eq!(e.symbols().string(s_id).get_bytes().as_ptr(), ptr);
+    let s2 = e.symbols().clone();
+    assert_eq!(s2.string(s_id).get_bytes(), b"\xff\xfe\x00x");
+    assert!(s2.string(s_id).capacity() >= 64);
+}
+
 #[test]
 fn test_vector() {
     let mut s = SymbolTable::new();
@@ -67,6 +88,78 @@ fn test_funcs() {
     assert_relative_eq!(e.value(), 10.);
 }
 
+#[test]
+fn test_func_options() {
+    use std::cell::Cell;
+    use std::rc::Rc;
+
+    let pure_calls = Rc::new(Cell::new(0));
+    let impure_calls = Rc::new(Cell::new(0));
+    let mut s = SymbolTable::new();
+    let c = pure_calls.clone();
+    s.add_func2("pure_pow", move |a, b| {
+        c.set(c.get() + 1);
+        a.powf(b)
+    })
+    .unwrap();
+    let c = impure_calls.clone();
+    s.add_func2_with_options(
+        "impure_pow",
+        FunctionOptions::with_side_effects(),
+        move |a, b| {
+            c.set(c.get() + 1);
+            a.powf(b)
+        },
+    )
+    .unwrap();
+
+    // folded at compile time
+    let mut e = Expression::new("pure_pow(3, 4) + 1", s.clone()).unwrap();
+    assert_eq!(pure_calls.get(), 1);
+    for _ in 0..3 {
+        assert_relative_eq!(e.value(), 82.);
+    }
+    assert_eq!(pure_calls.get(), 1);
+
+    // called on every evaluation (also after cloning)
+    let mut e = Expression::new("impure_pow(3, 4) + 1", s.clone()).unwrap();
+    assert_eq!(impure_calls.get(), 0);
+    for _ in 0..3 {
+        assert_relative_eq!(e.value(), 82.);
+    }
+    assert_eq!(impure_calls.get(), 3);
+    let mut e2 = e.clone();
+    assert_eq!(impure_calls.get(), 3);
+    assert_relative_eq!(e2.value(), 82.);
+    assert_eq!(impure_calls.get(), 4);
+}
+
+#[test]
+fn test_vararg_generic_funcs() {
+    let mut s = SymbolTable::new();
+    s.add_vararg_func("total", |args| args.iter().sum())
+        .unwrap();
+    assert!(!s.add_vararg_func("total", |_| 0.).unwrap());
+    s.add_vector("v", &[1., 2., 3.]).unwrap();
+    s.add_stringvar("s", "abc").unwrap();
+    s.add_generic_func("weigh", "VT|ST", |args| match args[0].value() {
+        GenericValue::Vector(v) => v.iter().sum::<f64>() * args[1].scalar().unwrap(),
+        GenericValue::String(s) => s.len() as f64 * args[1].scalar().unwrap(),
+        GenericValue::Scalar(_) => unreachable!(),
+    })
+    .unwrap();
+    let formula = "total(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12) + weigh(v, 2) + weigh(s, 10)";
+    let mut e = Expression::new(formula, s.clone()).unwrap();
+    assert_relative_eq!(e.value(), 78. + 12. + 30.);
+    // invalid parameter types
+    assert!(Expression::new("weigh(1, 2)", s.clone()).is_err());
+
+    // cloned functions
+    let mut e = Expression::new(formula, s.clone()).unwrap();
+    drop(s);
+    assert_relative_eq!(e.value(), 120.);
+}
+
 #[test]
 fn test_parse_err() {
     let mut s = SymbolTable::new();
@@ -85,6 +178,216 @@ fn test_parse_err() {
     }
 }
 
+#[test]
+fn test_parser_settings() {
+    let formula = "((((((x + 1) * 2) + 1) * 2) + 1) * 2) + 3x";
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 1.).unwrap();
+
+    let default = Parser::with_settings(&ParserSettings::default());
+    let mut expr = Expression::with_parser(formula, s.clone(), &default).unwrap();
+    assert_relative_eq!(expr.value(), 33.);
+
+    let no_insert = Parser::with_settings(&ParserSettings::new().commutative_check(false));
+    assert!(Expression::with_parser(formula, s.clone(), &no_insert).is_err());
+    assert!(Expression::with_parser("x * 3", s.clone(), &no_insert).is_ok());
+    assert_eq!(
+        no_insert.settings(),
+        &ParserSettings::new().commutative_check(false)
+    );
+
+    let shallow = Parser::with_settings(&ParserSettings::new().max_stack_depth(4));
+    assert!(Expression::with_parser(formula, s.clone(), &shallow).is_err());
+    assert!(Expression::with_parser("x + 1", s.clone(), &shallow).is_ok());
+
+    let no_vardef = Parser::with_settings(&ParserSettings::new().variable_definitions(false));
+    assert!(Expression::with_parser("var y := 2; x + y", s.clone(), &default).is_ok());
+    assert!(Expression::with_parser("var y := 2; x + y", s, &no_vardef).is_err());
+}
+
+#[test]
+fn test_eval_budget() {
+    use std::thread;
+    use std::time::{Duration, Instant};
+
+    let mut s = SymbolTable::new();
+    let n_id = s.add_variable("n", 0.).unwrap().unwrap();
+    let parser = Parser::with_settings(&ParserSettings::new().loop_budget(true));
+    let mut e = Expression::with_parser(
+        "var c := 0; for (var j := 0; j < n; j += 1) { var i := 0; while (i < j) { i += 1; c += 1 } }; c",
+        s,
+        &parser,
+    )
+    .unwrap();
+    // 100 + (0 + 1 + ... + 99) iterations in total
+    *e.symbols_mut().value_mut(n_id) = 100.;
+    assert_eq!(
+        e.value_with_budget(&EvalBudget::new().max_iterations(5050)),
+        Ok(4950.)
+    );
+    assert_eq!(
+        e.value_with_budget(&EvalBudget::new().max_iterations(5049)),
+        Err(EvalError::IterationLimit)
+    );
+    // clones keep the loop checks
+    assert_eq!(
+        e.clone()
+            .value_with_budget(&EvalBudget::new().max_iterations(5049)),
+        Err(EvalError::IterationLimit)
+    );
+    // the count starts again, and other evaluations are not limited
+    let budget = EvalBudget::new().max_iterations(5050);
+    assert_eq!(e.value_with_budget(&budget), Ok(4950.));
+    assert_eq!(e.value_with_budget(&budget), Ok(4950.));
+    *e.symbols_mut().value_mut(n_id) = 200.;
+    assert_eq!(e.value(), 19900.);
+
+    let (mut endless, _) = Expression::parse_vars_with_parser(
+        "while (x >= 0) { x += 1 }",
+        SymbolTable::new(),
+        &parser,
+    )
+    .unwrap();
+    let start = Instant::now();
+    let budget = EvalBudget::new().timeout(Duration::from_millis(20));
+    assert_eq!(endless.value_with_budget(&budget), Err(EvalError::Timeout));
+    assert!(start.elapsed() >= Duration::from_millis(20));
+    assert_eq!(endless.value_with_budget(&budget), Err(EvalError::Timeout));
+
+    let token = CancelToken::new();
+    let t = token.clone();
+    let handle = thread::spawn(move || {
+        thread::sleep(Duration::from_millis(10));
+        t.cancel();
+    });
+    let budget = EvalBudget::new().cancel_token(&token);
+    assert_eq!(
+        endless.value_with_budget(&budget),
+        Err(EvalError::Cancelled)
+    );
+    handle.join().unwrap();
+    assert!(token.is_cancelled());
+
+    // without loop checks, only the start of the evaluation is checked
+    let mut e = Expression::new(
+        "var c := 0; while (c < 100) { c += 1 }; c",
+        SymbolTable::new(),
+    )
+    .unwrap();
+    let budget = EvalBudget::new().max_iterations(10);
+    assert_eq!(e.value_with_budget(&budget), Ok(100.));
+}
+
+#[test]
+fn test_compile_timeout() {
+    use std::time::Duration;
+
+    let formula: Vec<_> = (0..2000).map(|i| format!("x * {}", i)).collect();
+    let formula = formula.join(" + ");
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 1.).unwrap();
+    let settings = ParserSettings::new().compile_timeout(Duration::from_nanos(1));
+    let parser = Parser::with_settings(&settings);
+    assert!(Expression::with_parser(&formula, s.clone(), &parser).is_err());
+    let settings = ParserSettings::new().compile_timeout(Duration::from_secs(60));
+    let parser = Parser::with_settings(&settings);
+    assert!(Expression::with_parser(&formula, s, &parser).is_ok());
+}
+
+#[test]
+fn test_eval_batch_async() {
+    use std::future::Future;
+    use std::pin::Pin;
+    use std::ptr;
+    use std::task::{Context, Poll, RawWaker, RawWakerVTable, Waker};
+    use std::time::Duration;
+
+    fn noop_waker() -> Waker {
+        unsafe fn clone(_: *const ()) -> RawWaker {
+            RawWaker::new(ptr::null(), &VTABLE)
+        }
+        unsafe fn noop(_: *const ()) {}
+        static VTABLE: RawWakerVTable = RawWakerVTable::new(clone, noop, noop, noop);
+        unsafe { Waker::from_raw(RawWaker::new(ptr::null(), &VTABLE)) }
+    }
+
+    // polls until ready, returns the output and the number of polls
+    fn block_on<F: Future + Unpin>(mut f: F) -> (F::Output, usize) {
+        let waker = noop_waker();
+        let mut cx = Context::from_waker(&waker);
+        let mut polls = 0;
+        loop {
+            polls += 1;
+            if let Poll::Ready(out) = Pin::new(&mut f).poll(&mut cx) {
+                return (out, polls);
+            }
+        }
+    }
+
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    let parser = Parser::with_settings(&ParserSettings::new().loop_budget(true));
+    let mut e = Expression::with_parser(
+        "var s := 0; for (var i := 0; i < x; i += 1) { s += i }; s",
+        s,
+        &parser,
+    )
+    .unwrap();
+    let x: Vec<_> = (0..10).map(|i| i as f64).collect();
+    let mut out = vec![0.; x.len()];
+
+    // yields after every row
+    let budget = EvalBudget::new().time_slice(Duration::from_secs(0));
+    let columns = [(x_id, &x[..])];
+    let (res, polls) = block_on(e.eval_batch_async(&columns, &mut out, budget.clone()));
+    assert_eq!(res, Ok(()));
+    assert_eq!(polls, 10);
+    assert_eq!(out, [0., 0., 1., 3., 6., 10., 15., 21., 28., 36.]);
+
+    let (res, polls) = block_on(e.eval_batch_async(&columns, &mut out, EvalBudget::new()));
+    assert_eq!(res, Ok(()));
+    assert_eq!(polls, 1);
+
+    // the iteration limit applies to each row
+    let mut out = vec![0.; x.len()];
+    let budget = EvalBudget::new().max_iterations(6);
+    let mut f = e.eval_batch_async(&columns, &mut out, budget);
+    let waker = noop_waker();
+    let res = Pin::new(&mut f).poll(&mut Context::from_waker(&waker));
+    assert_eq!(res, Poll::Ready(Err(EvalError::IterationLimit)));
+    assert_eq!(f.rows_done(), 7);
+    drop(f);
+    assert_eq!(&out[..7], &[0., 0., 1., 3., 6., 10., 15.]);
+}
+
+#[cfg(feature = "stats")]
+#[test]
+fn test_stats() {
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 1.).unwrap();
+    let mut e1 = Expression::new("x + 1", s.clone()).unwrap();
+    let (mut e2, _) = Expression::parse_vars("x * y", SymbolTable::new()).unwrap();
+    for _ in 0..5 {
+        e1.value();
+    }
+    e2.value();
+    assert_eq!(e1.stats().compilations, 1);
+    assert_eq!(e1.stats().evaluations, 5);
+    assert_eq!(e1.stats().eval_histogram.iter().sum::<u64>(), 5);
+    assert!(e1.stats().mean_eval_time().is_some());
+    assert_eq!(e2.stats().compilations, 1);
+
+    let total: Stats = [e1.stats().clone(), e2.stats().clone()].iter().sum();
+    assert_eq!(total.compilations, 2);
+    assert_eq!(total.evaluations, 6);
+    assert_eq!(total.tokens, e1.stats().tokens + e2.stats().tokens);
+    assert_eq!(total.eval_time, e1.stats().eval_time + e2.stats().eval_time);
+
+    e1.reset_stats();
+    assert_eq!(e1.stats(), &Stats::default());
+    assert_eq!(e1.stats().eval_time_quantile(0.5), None);
+}
+
 #[test]
 fn test_resolver() {
     let mut s = SymbolTable::new();
@@ -118,6 +421,22 @@ fn test_auto_resolver() {
     assert_relative_eq!(expr.value(), 0.);
     expr.symbols().value_cell(0).set(1.);
     assert_relative_eq!(expr.value(), 1.);
+
+    // existing variables, repeated names and reused parsers
+    let parser = Parser::new();
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 2.).unwrap();
+    for _ in 0..2 {
+        let (mut expr, vars) =
+            Expression::parse_vars_with_parser("a * x + b / x + a", s.clone(), &parser).unwrap();
+        assert_eq!(vars, vec![("a".to_string(), 1), ("b".to_string(), 2)]);
+        assert_eq!(expr.symbols().get_var_id("b").unwrap(), Some(2));
+        *expr.symbols_mut().value_mut(1) = 1.;
+        *expr.symbols_mut().value_mut(2) = 4.;
+        assert_relative_eq!(expr.value(), 5.);
+        assert_eq!(expr.clone().value(), 5.);
+    }
+    assert!(Expression::parse_vars_with_parser("a +", s, &parser).is_err());
 }
 
 #[test]
@@ -167,6 +486,131 @@ fn test_ids() {
     assert_eq!(s.get_vec_id("s").unwrap(), None);
 }
 
+#[test]
+fn test_variable_block() {
+    let mut s = SymbolTable::with_variable_block(&["a", "b", "c"]).unwrap();
+    assert_eq!(s.variable_block(), &[0., 0., 0.]);
+    assert_eq!(s.variable_block().as_ptr() as usize % 64, 0);
+    assert_eq!(s.get_var_id("b"), Ok(Some(1)));
+    let d_id = s.add_variable("d", 10.).unwrap().unwrap();
+    assert_eq!(d_id, 3);
+    s.variable_block_mut().copy_from_slice(&[1., 2., 3.]);
+    assert_eq!(s.value(2), 3.);
+
+    let mut expr = Expression::new("a + 2 * b + 3 * c + d", s.clone()).unwrap();
+    assert_relative_eq!(expr.value(), 24.);
+    expr.symbols_mut().variable_block_mut()[0] = 2.;
+    *expr.symbols_mut().value_mut(1) = 0.;
+    assert_relative_eq!(expr.value(), 21.);
+    assert_eq!(expr.symbols().variable_block(), &[2., 0., 3.]);
+
+    // no block
+    assert!(SymbolTable::new().variable_block().is_empty());
+    // duplicate / invalid names
+    assert!(SymbolTable::with_variable_block(&["a", "a"]).is_err());
+    assert!(SymbolTable::with_variable_block(&["a", "1b"]).is_err());
+}
+
+#[test]
+fn test_row_binding() {
+    #[derive(Clone, Copy, Debug, Default, PartialEq)]
+    #[repr(C)]
+    struct Record {
+        flag: u8,
+        x: f64,
+        y: f64,
+        z: f64,
+    }
+
+    let mut s = SymbolTable::new();
+    let c_id = s.add_variable("c", 1.).unwrap().unwrap();
+    let binding = s
+        .bind_row(Record::default(), &[("x", |r| &r.x), ("z", |r| &r.z)])
+        .unwrap();
+    assert_eq!(binding.var_ids(), &[1, 2]);
+    assert_eq!(s.get_var_id("z"), Ok(Some(2)));
+
+    let mut expr = Expression::new("x - z + c", s.clone()).unwrap();
+    let r = Record {
+        flag: 1,
+        x: 5.,
+        y: 100.,
+        z: 2.,
+    };
+    expr.symbols_mut().set_row(&binding, &r);
+    assert_eq!(expr.symbols().row(&binding), &r);
+    assert_eq!(expr.symbols().value(binding.var_ids()[0]), 5.);
+    assert_relative_eq!(expr.value(), 4.);
+    expr.symbols_mut().row_mut(&binding).z = 0.;
+    *expr.symbols_mut().value_mut(c_id) = 0.;
+    assert_relative_eq!(expr.value(), 5.);
+
+    // offsets, duplicate names
+    let binding2 = unsafe { s.bind_row_offsets([0f64; 3], &[("v0", 0), ("v2", 16)]) }.unwrap();
+    s.set_row(&binding2, &[1., 2., 3.]);
+    assert_eq!(s.value(binding2.var_ids()[1]), 3.);
+    assert!(s.bind_row(Record::default(), &[("x", |r| &r.y)]).is_err());
+}
+
+#[test]
+fn test_row_binding_invalid_name() {
+    #[derive(Clone, Copy, Default)]
+    #[repr(C)]
+    struct Record {
+        x: f64,
+        y: f64,
+    }
+
+    let mut s = SymbolTable::new();
+    s.add_variable("c", 1.).unwrap();
+    // already present, given twice, rejected by ExprTk
+    for fields in &[
+        [("x", 0), ("c", 8)],
+        [("x", 0), ("x", 8)],
+        [("x", 0), ("1y", 8)],
+    ] {
+        assert!(unsafe { s.bind_row_offsets(Record::default(), fields) }.is_err());
+        assert_eq!(s.get_var_id("x"), Ok(None));
+        assert_eq!(s.symbol_exists("x"), Ok(false));
+        assert_eq!(s.get_variable_names(), ["c"]);
+    }
+    let binding = s
+        .bind_row(Record::default(), &[("x", |r| &r.x), ("y", |r| &r.y)])
+        .unwrap();
+    assert_eq!(binding.var_ids(), &[1, 2]);
+    s.set_row(&binding, &Record { x: 2., y: 3. });
+    assert_eq!(s.value(2), 3.);
+}
+
+#[test]
+fn test_id_lookup() {
+    let mut s = SymbolTable::new();
+    s.add_constant("c", 1.).unwrap();
+    let b_id = s.add_variable("b", 2.).unwrap().unwrap();
+    assert_eq!(s.get_var_id("c").unwrap(), None);
+    assert_eq!(s.get_var_id("b\0"), Err(InvalidName("b\0".to_string())));
+    let s_id = s.add_stringvar("s", "").unwrap().unwrap();
+    let v_id = s.add_vector("v", &[1.]).unwrap().unwrap();
+    // same as ExprTk (case insensitive with the default features)
+    let ci = |id| {
+        if exprtk_sys::CASE_INSENSITIVE {
+            Some(id)
+        } else {
+            None
+        }
+    };
+    assert_eq!(s.get_var_id("B").unwrap(), ci(b_id));
+    assert_eq!(s.get_string_id("S").unwrap(), ci(s_id));
+    assert_eq!(s.get_vec_id("V").unwrap(), ci(v_id));
+    if exprtk_sys::CASE_INSENSITIVE {
+        assert_relative_eq!(s.value_from_name("B").unwrap(), 2.);
+    }
+    assert_relative_eq!(s.value_from_name("c").unwrap(), 1.);
+    assert_relative_eq!(s.value_from_name("b").unwrap(), 2.);
+    s.clear_variables();
+    assert_eq!(s.get_var_id("b").unwrap(), None);
+}
+
 #[test]
 fn test_clone() {
     let mut s = SymbolTable::new();
@@ -180,6 +624,41 @@ fn test_clone() {
     assert_eq!(format!("{:?}", expr), format!("{:?}", expr.clone()));
 }
 
+#[test]
+fn test_serialize() {
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 1.).unwrap();
+    s.add_vector("v", &[1., 2., 3.]).unwrap();
+    let expr = Expression::new("x + sum(v)", s.clone()).unwrap();
+    let mut blob = vec![];
+    expr.serialize(&mut blob);
+    expr.serialize(&mut blob);
+
+    let mut data = &blob[..];
+    let mut e = Expression::deserialize(&mut data, s.clone()).unwrap();
+    assert_eq!(e.formula(), "x + sum(v)");
+    assert_relative_eq!(e.value(), 7.);
+    assert_eq!(data.len(), blob.len() / 2);
+
+    let mut other = SymbolTable::new();
+    other.add_variable("x", 1.).unwrap();
+    other.add_vector("v", &[1., 2.]).unwrap();
+    assert_eq!(
+        Expression::deserialize(&mut &blob[..], other).unwrap_err(),
+        LoadError::LayoutMismatch
+    );
+    assert_eq!(
+        Expression::deserialize(&mut &blob[..10], s.clone()).unwrap_err(),
+        LoadError::InvalidFormat
+    );
+    let mut corrupted = blob.clone();
+    corrupted[8] ^= 1;
+    assert_eq!(
+        Expression::deserialize(&mut &corrupted[..], s).unwrap_err(),
+        LoadError::VersionMismatch
+    );
+}
+
 #[test]
 fn test_send() {
     use std::thread;
@@ -198,3 +677,589 @@ fn test_send() {
         assert_relative_eq!(e.value(), 6.);
     });
 }
+
+#[test]
+fn test_compact() {
+    use std::rc::Rc;
+
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 2.).unwrap().unwrap();
+    s.add_stringvar("s", "abc").unwrap();
+    s.add_func1("double", |x| x * 2.).unwrap();
+    let symbols = Rc::new(s);
+
+    let mut a = CompactExpression::new("double(x) + s[]", &symbols).unwrap();
+    let mut b = CompactExpression::with_formula("x^2", &symbols).unwrap();
+    assert_eq!(a.value(), 7.);
+    assert_eq!(b.value(), 4.);
+    assert_eq!(a.formula(), None);
+    assert_eq!(b.formula(), Some("x^2"));
+    assert!(CompactExpression::new("x + y", &symbols).is_err());
+
+    symbols.value_cell(x_id).set(3.);
+    assert_eq!(a.value(), 9.);
+    assert_eq!(b.value(), 9.);
+
+    let full = Expression::new("x^2", (*symbols).clone()).unwrap();
+    assert!(b.estimated_memory_usage() < full.estimated_memory_usage());
+
+    // the parser does not keep references to the table after compiling
+    let mut exprs: Vec<_> = (0..100)
+        .map(|i| CompactExpression::new(&format!("x + {}", i), &symbols).unwrap())
+        .collect();
+    assert_eq!(Rc::strong_count(&symbols), 103);
+
+    // the symbol table lives as long as the expressions
+    drop(symbols);
+    drop(a);
+    assert_eq!(b.value(), 9.);
+    assert_eq!(exprs[50].value(), 53.);
+}
+
+#[test]
+fn test_with_parser() {
+    let parser = Parser::new();
+    let mut s = SymbolTable::new();
+    let a_id = s.add_variable("a", 1.).unwrap().unwrap();
+    let mut e1 = Expression::with_parser("a + 1", s.clone(), &parser).unwrap();
+    let mut e2 = Expression::with_parser("a * 3", s, &parser).unwrap();
+    assert_relative_eq!(e1.value(), 2.);
+    assert_relative_eq!(e2.value(), 3.);
+    e2.symbols().value_cell(a_id).set(2.);
+    assert_relative_eq!(e1.value(), 2.);
+    assert_relative_eq!(e2.value(), 6.);
+    // errors leave the parser in a usable state
+    assert!(Expression::with_parser("a +", SymbolTable::new(), &parser).is_err());
+    let mut e3 = Expression::with_parser("2 + 2", SymbolTable::new(), &parser).unwrap();
+    assert_relative_eq!(e3.value(), 4.);
+}
+
+#[test]
+fn test_pooled_parser_recursive() {
+    // compiling from within a resolver needs a second parser from the pool
+    let mut expr = Expression::handle_unknown("a + 1", SymbolTable::new(), |name, s| {
+        let mut inner = Expression::new("2 * 3", SymbolTable::new()).unwrap();
+        s.add_variable(name, inner.value()).unwrap();
+        Ok(())
+    })
+    .unwrap();
+    assert_relative_eq!(expr.value(), 7.);
+}
+
+#[test]
+fn test_eval_batch() {
+    let mut s = SymbolTable::new();
+    let a_id = s.add_variable("a", 0.).unwrap().unwrap();
+    let b_id = s.add_variable("b", 10.).unwrap().unwrap();
+    let mut e = Expression::new("a * 2 + b", s).unwrap();
+    let a = [1., 2., 3., 4.];
+    let mut out = [0.; 4];
+    e.eval_batch(&[(a_id, &a)], &mut out);
+    assert_eq!(out, [12., 14., 16., 18.]);
+    assert_relative_eq!(e.symbols().value(a_id), 4.);
+    assert_relative_eq!(e.symbols().value(b_id), 10.);
+    // empty input
+    e.eval_batch(&[(a_id, &[])], &mut []);
+}
+
+#[test]
+#[should_panic(expected = "Column length")]
+fn test_eval_batch_length() {
+    let mut s = SymbolTable::new();
+    let a_id = s.add_variable("a", 0.).unwrap().unwrap();
+    let mut e = Expression::new("a", s).unwrap();
+    e.eval_batch(&[(a_id, &[1., 2.])], &mut [0.; 3]);
+}
+
+#[test]
+fn test_vector_view() {
+    let mut data = vec![0., 1., 2., 3.];
+    let mut s = SymbolTable::new();
+    let v_id = unsafe { s.add_vector_view("v", &mut data) }
+        .unwrap()
+        .unwrap();
+    assert_eq!(s.get_vec_id("v").unwrap(), Some(v_id));
+    let mut e = Expression::new("v[] + v[1] + 1", s).unwrap();
+    assert_relative_eq!(e.value(), 6.);
+    e.symbols_mut().vector_mut(v_id)[1] = 2.;
+    assert_relative_eq!(e.value(), 7.);
+    // written through to the buffer
+    assert_eq!(data[1], 2.);
+
+    let mut data2 = vec![10., 20., 30., 40.];
+    unsafe { e.symbols_mut().rebind_vector(v_id, &mut data2) };
+    assert_relative_eq!(e.value(), 25.);
+    assert_eq!(e.symbols().vector(v_id), &[10., 20., 30., 40.]);
+    assert_eq!(e.symbols().get_vec_id("v").unwrap(), Some(v_id));
+}
+
+#[test]
+fn test_vector_view_assign() {
+    let mut data = vec![0.; 3];
+    let mut s = SymbolTable::new();
+    unsafe { s.add_vector_view("v", &mut data) }
+        .unwrap()
+        .unwrap();
+    let mut e = Expression::new("v[0] := 1; v[1] := 2; v[2] := 3; v[0] + v[1] + v[2]", s).unwrap();
+    assert_relative_eq!(e.value(), 6.);
+    drop(e);
+    assert_eq!(data, vec![1., 2., 3.]);
+}
+
+#[test]
+fn test_vector_view_resize() {
+    let mut data = vec![1., 2., 3., 4.];
+    let mut s = SymbolTable::new();
+    let v_id = unsafe { s.add_vector_view("v", &mut data) }
+        .unwrap()
+        .unwrap();
+    let mut e = Expression::new("v[] * 100 + sum(v)", s).unwrap();
+    assert_relative_eq!(e.value(), 410.);
+
+    let mut chunk = vec![5., 6.];
+    unsafe { e.symbols_mut().rebind_vector(v_id, &mut chunk) };
+    assert_relative_eq!(e.value(), 211.);
+    assert_eq!(e.symbols().vector(v_id), &[5., 6.]);
+    assert_eq!(e.symbols().vector_base_len(v_id), 4);
+
+    // clones keep the current length
+    let mut e2 = e.clone();
+    assert_relative_eq!(e2.value(), 211.);
+
+    unsafe { e.symbols_mut().rebind_vector(v_id, &mut data) };
+    assert_relative_eq!(e.value(), 410.);
+}
+
+#[test]
+#[should_panic(expected = "Invalid vector length")]
+fn test_vector_view_too_long() {
+    let mut data = vec![1., 2.];
+    let mut s = SymbolTable::new();
+    let v_id = unsafe { s.add_vector_view("v", &mut data) }
+        .unwrap()
+        .unwrap();
+    let mut longer = vec![1., 2., 3.];
+    unsafe { s.rebind_vector(v_id, &mut longer) };
+}
+
+#[test]
+fn test_clone_ids() {
+    let mut s = SymbolTable::new();
+    let b_id = s.add_variable("b", 1.).unwrap().unwrap();
+    assert_eq!(s.add_variable("b", 1.), Ok(None));
+    let a_id = s.add_variable("a", 2.).unwrap().unwrap();
+    let t_id = s.add_stringvar("t", "t").unwrap().unwrap();
+    let s_id = s.add_stringvar("s", "s").unwrap().unwrap();
+    let s2 = s.clone();
+    assert_eq!(s2.get_var_id("b").unwrap(), Some(b_id));
+    assert_eq!(s2.get_var_id("a").unwrap(), Some(a_id));
+    assert_eq!(s2.get_string_id("t").unwrap(), Some(t_id));
+    assert_eq!(s2.get_string_id("s").unwrap(), Some(s_id));
+    assert_relative_eq!(s2.value(a_id), 2.);
+}
+
+#[cfg(feature = "parallel")]
+#[test]
+fn test_parallel() {
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    let y_id = s.add_variable("y", 0.).unwrap().unwrap();
+    let e = Expression::new("x * y + 1", s).unwrap();
+    let mut evaluator = ParallelEvaluator::with_instances(e, 3).chunk_size(7);
+    let x: Vec<f64> = (0..100).map(|i| i as f64).collect();
+    let y: Vec<f64> = (0..100).map(|i| (i * 2) as f64).collect();
+    let mut out = vec![0.; 100];
+    evaluator.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+    for i in 0..100 {
+        assert_relative_eq!(out[i], x[i] * y[i] + 1.);
+    }
+    evaluator.for_each_instance(|e| e.symbols().value_cell(y_id).set(-1.));
+    evaluator.eval_batch(&[(x_id, &x)], &mut out);
+    assert_relative_eq!(out[10], -9.);
+}
+
+#[cfg(feature = "parallel")]
+#[test]
+fn test_compile_many() {
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 3.).unwrap();
+    let mut formulas: Vec<_> = (0..200).map(|i| format!("x + {}", i)).collect();
+    formulas[17] = "x +".to_string();
+    let exprs = compile_many(&formulas, &s);
+    assert_eq!(exprs.len(), formulas.len());
+    for (i, r) in exprs.into_iter().enumerate() {
+        match r {
+            Ok(mut e) => {
+                assert_eq!(e.formula(), formulas[i]);
+                assert_relative_eq!(e.value(), 3. + i as f64);
+            }
+            Err(_) => assert_eq!(i, 17),
+        }
+    }
+
+    let exprs = compile_many_resolve(&["a + 1", "a + b"], &s, |name, s| {
+        s.add_variable(name, 1.).unwrap();
+        Ok(())
+    });
+    assert_eq!(exprs[1].as_ref().unwrap().symbols().variable_count(), 3);
+}
+
+#[test]
+fn test_clone_constants() {
+    let mut s = SymbolTable::new();
+    s.add_constants();
+    s.add_constant("c", 3.).unwrap();
+    let x_id = s.add_variable("x", 2.).unwrap().unwrap();
+    let e = Expression::new("x * c + pi - pi + epsilon * 0", s).unwrap();
+    e.symbols().value_cell(x_id).set(3.);
+    let mut e2 = e.clone();
+    assert_relative_eq!(e2.value(), 9.);
+    assert!(e2.symbols().is_constant_node("c").unwrap());
+    assert!(e2.symbols().is_constant_node("inf").unwrap());
+    assert_eq!(format!("{:?}", e.symbols()), format!("{:?}", e2.symbols()));
+    let mut s = e2.symbols().clone();
+    s.clear_variables();
+    assert!(s.clone().get_variable_names().is_empty());
+}
+
+#[test]
+fn test_cache() {
+    let mut cache = ExpressionCache::new(2);
+    let mut s = SymbolTable::new();
+    let a_id = s.add_variable("a", 1.).unwrap().unwrap();
+    let v_id = s.add_vector("v", &[1., 2.]).unwrap().unwrap();
+
+    let mut e1 = cache.get("a + v[1]", &s).unwrap();
+    let e2 = cache.get("a + v[1]", &s).unwrap();
+    assert_relative_eq!(e1.value(), 3.);
+    cache.put(e1);
+    cache.put(e2);
+    assert_eq!(cache.len(), 2);
+    assert!(cache.memory_usage() > 0);
+
+    *s.value_mut(a_id) = 2.;
+    s.vector_mut(v_id)[1] = 10.;
+    let mut e = cache.get("a + v[1]", &s).unwrap();
+    assert_relative_eq!(e.value(), 12.);
+    assert_eq!(
+        cache.stats(),
+        CacheStats {
+            hits: 1,
+            misses: 2,
+            evictions: 0
+        }
+    );
+    cache.put(e);
+
+    // different symbols -> miss
+    let mut s2 = s.clone();
+    s2.add_variable("b", 0.).unwrap();
+    let e = cache.get("a + v[1]", &s2).unwrap();
+    assert_eq!(cache.stats().misses, 3);
+    // evicts the least recently used one
+    cache.put(e);
+    assert_eq!(cache.len(), 2);
+    assert_eq!(cache.stats().evictions, 1);
+    assert!(cache.get("a + v[1]", &s2).is_ok());
+    assert_eq!(cache.stats().hits, 2);
+
+    // errors are not cached
+    assert!(cache.get("a +", &s).is_err());
+
+    let mut cache = ExpressionCache::with_memory_limit(10, 0);
+    cache.put(Expression::new("a + v[1]", s.clone()).unwrap());
+    assert!(cache.is_empty());
+    // the oldest expressions are evicted to stay within the limit
+    let mut cache = ExpressionCache::new(10);
+    cache.put(Expression::new("a + v[1]", s.clone()).unwrap());
+    let bytes = cache.memory_usage();
+    let mut cache = ExpressionCache::with_memory_limit(10, bytes * 2);
+    for _ in 0..3 {
+        cache.put(Expression::new("a + v[1]", s.clone()).unwrap());
+    }
+    assert_eq!(cache.len(), 2);
+    assert!(cache.memory_usage() <= bytes * 2);
+}
+
+#[test]
+fn test_block_eval() {
+    let mut s = SymbolTable::new();
+    s.add_pi();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    let y_id = s.add_variable("y", 2.).unwrap().unwrap();
+    let x: Vec<f64> = (0..1300).map(|i| i as f64 * 0.01 - 5.).collect();
+    for formula in &[
+        "(5.5 + x) + (2 * x - 2 / 3 * y) * (x / 3 + y / 4) + (y + 7.7)",
+        "sin(pi * x) * exp(-abs(x)) / (1 + sqrt(y))",
+        "max(x, y, 1) - min(x % 3, 0) + x^3 - 2^x",
+    ] {
+        let mut reference = Expression::new(formula, s.clone()).unwrap();
+        let mut expected = vec![0.; x.len()];
+        reference.eval_batch(&[(x_id, &x)], &mut expected);
+
+        let mut evaluator = BlockEvaluator::new(Expression::new(formula, s.clone()).unwrap());
+        assert!(evaluator.is_vectorized(), "{}", formula);
+        let mut out = vec![0.; x.len()];
+        evaluator.eval_batch(&[(x_id, &x)], &mut out);
+        for (&o, &e) in out.iter().zip(&expected) {
+            assert_relative_eq!(o, e, max_relative = 1e-12);
+        }
+        let symbols = evaluator.expression().symbols();
+        assert_eq!(symbols.value(x_id), x[x.len() - 1]);
+        assert_eq!(symbols.value(y_id), 2.);
+    }
+}
+
+#[test]
+fn test_eval_batch_f32() {
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    let x: Vec<f32> = (0..1300).map(|i| i as f32 * 0.25 - 100.).collect();
+    let x64: Vec<f64> = x.iter().map(|&v| v as f64).collect();
+    for &formula in &["x * 3 + abs(x) / 7", "if (x > 0) x / 3; else -x"] {
+        let mut expected = vec![0.; x.len()];
+        let mut reference = Expression::new(formula, s.clone()).unwrap();
+        reference.eval_batch(&[(x_id, &x64)], &mut expected);
+        let expected: Vec<f32> = expected.iter().map(|&v| v as f32).collect();
+
+        let mut out = vec![0f32; x.len()];
+        let mut expr = Expression::new(formula, s.clone()).unwrap();
+        expr.eval_batch_f32(&[(x_id, &x)], &mut out);
+        assert_eq!(out, expected);
+        assert_eq!(expr.symbols().value(x_id), x[x.len() - 1] as f64);
+
+        let mut out = vec![0f32; x.len()];
+        let mut evaluator = BlockEvaluator::new(expr);
+        evaluator.eval_batch_f32(&[(x_id, &x)], &mut out);
+        for (&o, &e) in out.iter().zip(&expected) {
+            assert_relative_eq!(o, e, max_relative = 1e-6);
+        }
+    }
+}
+
+#[test]
+fn test_block_fallback() {
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    s.add_func1("f", |x| x * 2.).unwrap();
+    for formula in &["if (x > 1) 1; else 2", "-x^2", "f(x)", "2x"] {
+        let mut reference = Expression::new(formula, s.clone()).unwrap();
+        let mut evaluator = BlockEvaluator::new(Expression::new(formula, s.clone()).unwrap());
+        assert!(!evaluator.is_vectorized(), "{}", formula);
+        let x = [-1., 0., 2.];
+        let mut expected = [0.; 3];
+        let mut out = [0.; 3];
+        reference.eval_batch(&[(x_id, &x)], &mut expected);
+        evaluator.eval_batch(&[(x_id, &x)], &mut out);
+        assert_eq!(out, expected);
+    }
+}
+
+#[test]
+fn test_vec_func() {
+    let mut s = SymbolTable::new();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    let y_id = s.add_variable("y", 0.).unwrap().unwrap();
+    assert!(s
+        .add_vec_func("wsum", 3, |args, out| {
+            for (i, o) in out.iter_mut().enumerate() {
+                *o = args[0][i] + 2. * args[1][i] + 3. * args[2][i];
+            }
+        })
+        .unwrap());
+    assert!(!s.add_vec_func("wsum", 1, |_, _| ()).unwrap());
+
+    // scalar evaluation by ExprTk
+    let mut expr = Expression::new("wsum(x, y, 1) - 1", s.clone()).unwrap();
+    *expr.symbols_mut().value_mut(x_id) = 1.;
+    *expr.symbols_mut().value_mut(y_id) = 2.;
+    assert_eq!(expr.value(), 7.);
+
+    // block-wise evaluation (more than one block)
+    let n = 1200;
+    let x: Vec<_> = (0..n).map(|i| i as f64).collect();
+    let y: Vec<_> = (0..n).map(|i| -(i as f64) / 2.).collect();
+    let formula = "wsum(x, y * 2, wsum(1, x, y)) / 2";
+    let mut reference = Expression::new(formula, s.clone()).unwrap();
+    let mut evaluator = BlockEvaluator::new(Expression::new(formula, s).unwrap());
+    assert!(evaluator.is_vectorized());
+    let mut expected = vec![0.; n];
+    let mut out = vec![0.; n];
+    reference.eval_batch(&[(x_id, &x), (y_id, &y)], &mut expected);
+    evaluator.eval_batch(&[(x_id, &x), (y_id, &y)], &mut out);
+    assert_eq!(out, expected);
+}
+
+#[test]
+fn test_incremental() {
+    let mut s = SymbolTable::new();
+    let ids: Vec<_> = (0..20)
+        .map(|i| {
+            s.add_variable(&format!("x{}", i), i as f64)
+                .unwrap()
+                .unwrap()
+        })
+        .collect();
+    s.add_vec_func("f", 2, |args, out| {
+        for (o, (&a, &b)) in out.iter_mut().zip(args[0].iter().zip(args[1])) {
+            *o = a * 2. + b;
+        }
+    })
+    .unwrap();
+    let formula = (0..20)
+        .map(|i| format!("sin(x{}) * f(x{}, {})", i, (i + 1) % 20, i))
+        .collect::<Vec<_>>()
+        .join(" + ");
+    let mut reference = Expression::new(&formula, s.clone()).unwrap();
+    let mut e = IncrementalExpression::new(Expression::new(&formula, s).unwrap());
+    assert!(e.is_incremental());
+    for step in 0..10 {
+        let var_id = ids[(step * 7) % ids.len()];
+        let x = step as f64 * 0.3 - 1.;
+        *reference.symbols_mut().value_mut(var_id) = x;
+        e.expression().symbols().value_cell(var_id).set(x);
+        assert_relative_eq!(e.value(), reference.value(), max_relative = 1e-12);
+        // unchanged
+        assert_relative_eq!(e.value(), reference.value(), max_relative = 1e-12);
+    }
+
+    let mut s = SymbolTable::new();
+    s.add_variable("x", 1.).unwrap();
+    let mut e = IncrementalExpression::new(Expression::new("x := x + 1", s).unwrap());
+    assert!(!e.is_incremental());
+    assert_relative_eq!(e.value(), 2.);
+    assert_relative_eq!(e.value(), 3.);
+}
+
+#[test]
+fn test_expression_set() {
+    let mut s = SymbolTable::new();
+    s.add_pi();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    s.add_variable("y", 2.).unwrap();
+    let formulas = [
+        "sin(x * pi) + (y + x)",
+        "(x + y) * sin(pi * x)",
+        "if (x > 1) x; else y",
+        "sin(x * pi)",
+    ];
+    let mut set = ExpressionSet::new(&formulas, s.clone()).unwrap();
+    assert_eq!(set.len(), 4);
+    assert_eq!(set.fallback_count(), 1);
+    assert!(set.shared_count() >= 7);
+    let mut reference: Vec<_> = formulas
+        .iter()
+        .map(|f| Expression::new(f, s.clone()).unwrap())
+        .collect();
+    let mut out = [0.; 4];
+    for &x in &[-1., 0.5, 3.] {
+        *set.symbols_mut().value_mut(x_id) = x;
+        set.value_all(&mut out);
+        for (o, e) in out.iter().zip(&mut reference) {
+            *e.symbols_mut().value_mut(x_id) = x;
+            assert_relative_eq!(*o, e.value(), max_relative = 1e-12);
+        }
+    }
+    assert!(ExpressionSet::new(&["x +"], s.clone()).is_err());
+
+    // the fallbacks use the symbol table of the set
+    let y_id = s.get_var_id("y").unwrap().unwrap();
+    let mut set = ExpressionSet::new(&["y := x * 3", "if (y > 0) y + 1; else 0"], s).unwrap();
+    assert_eq!(set.fallback_count(), 2);
+    *set.symbols_mut().value_mut(x_id) = 2.;
+    let mut out = [0.; 2];
+    set.value_all(&mut out);
+    assert_eq!(out, [6., 7.]);
+    assert_eq!(set.symbols().value(y_id), 6.);
+}
+
+#[cfg(feature = "arrow")]
+#[test]
+fn test_arrow() {
+    use arrow::array::{Array, Float32Array, Float64Array, Int32Array};
+    use arrow::datatypes::{DataType, Field, Schema};
+    use arrow::record_batch::RecordBatch;
+    use std::sync::Arc;
+
+    let schema = Arc::new(Schema::new(vec![
+        Field::new("a", DataType::Int32, true),
+        Field::new("b", DataType::Float64, true),
+        Field::new("c", DataType::Float64, false),
+    ]));
+    let mut s = SymbolTable::new();
+    s.add_constant("k", 10.).unwrap();
+    let mut evaluator = ArrowEvaluator::with_symbols("a * k + b", s, &schema).unwrap();
+    assert_eq!(evaluator.columns().len(), 2);
+    assert!(evaluator.is_vectorized());
+    for _ in 0..2 {
+        let batch = RecordBatch::try_new(
+            schema.clone(),
+            vec![
+                Arc::new(Int32Array::from(vec![Some(1), Some(2), None, Some(4)])),
+                Arc::new(Float64Array::from(vec![
+                    Some(0.5),
+                    None,
+                    Some(1.),
+                    Some(2.),
+                ])),
+                Arc::new(Float64Array::from(vec![0., 0., 0., 0.])),
+            ],
+        )
+        .unwrap();
+        let out = evaluator.evaluate(&batch).unwrap();
+        assert_eq!(out.len(), 4);
+        assert_eq!(out.value(0), 10.5);
+        assert!(out.is_null(1));
+        assert!(out.is_null(2));
+        assert_eq!(out.value(3), 42.);
+    }
+    assert!(ArrowEvaluator::new("a + d", &schema).is_err());
+
+    // single precision columns are not converted
+    let schema = Arc::new(Schema::new(vec![
+        Field::new("x", DataType::Float32, true),
+        Field::new("y", DataType::Float32, false),
+    ]));
+    let mut evaluator = ArrowEvaluator::new("x / y", &schema).unwrap();
+    let batch = RecordBatch::try_new(
+        schema,
+        vec![
+            Arc::new(Float32Array::from(vec![Some(1.), None, Some(3.)])),
+            Arc::new(Float32Array::from(vec![4f32, 4., 3.])),
+        ],
+    )
+    .unwrap();
+    let out = evaluator.evaluate(&batch).unwrap();
+    assert_eq!(out.value(0), 0.25);
+    assert!(out.is_null(1));
+    assert_eq!(out.value(2), 1.);
+}
+
+#[cfg(feature = "jit")]
+#[test]
+fn test_jit() {
+    let mut s = SymbolTable::new();
+    s.add_pi();
+    let x_id = s.add_variable("x", 0.).unwrap().unwrap();
+    s.add_variable("y", 3.).unwrap().unwrap();
+    let compiled = cfg!(all(target_arch = "x86_64", unix));
+    for &(formula, supported) in &[
+        ("(y + x / y) * (x - y / x)", true),
+        ("sqrt(111.111 - sin(2 * x) + cos(pi / y) / 333.333)", true),
+        ("min(x, y) - max(-x, 1, y) + abs(x) % 2 + x^y", true),
+        (
+            "((x + 1) * (x - 2)) / ((x + 3) * (y - (x * (y + 1))))",
+            true,
+        ),
+        ("if (x > 1) x; else -x", false),
+    ] {
+        let mut reference = Expression::new(formula, s.clone()).unwrap();
+        let mut e = JitExpression::new(Expression::new(formula, s.clone()).unwrap());
+        assert_eq!(e.is_compiled(), supported && compiled, "{}", formula);
+        for &x in &[-2.5, -1., 0.5, 2., 7.] {
+            *reference.symbols_mut().value_mut(x_id) = x;
+            *e.expression_mut().symbols_mut().value_mut(x_id) = x;
+            assert_relative_eq!(e.value(), reference.value(), max_relative = 1e-12);
+        }
+    }
+}